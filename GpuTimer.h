@@ -0,0 +1,56 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <GL/glew.h>
+#include <vector>
+using namespace std;
+
+/*
+* Measures how long the GPU spends on a span of commands with GL_TIME_ELAPSED queries. Spans are recorded back to
+* back between Begin and End, each with its own query, and only read once the GPU is done with them, so recording
+* never waits. Queries are reused after Reset.
+*/
+class GpuTimer
+{
+public:
+	void Begin()
+	{
+		if (next == queries.size())
+		{
+			GLuint query;
+			glGenQueries(1, &query);
+			queries.push_back(query);
+		}
+		glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+	}
+
+	void End()
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		next++;
+	}
+
+	unsigned int Count() const { return next; }
+
+	// average duration of the spans recorded since the last Reset. Blocks until all of them have finished.
+	double GetAverageMilliseconds() const
+	{
+		if (next == 0) return 0.0;
+
+		GLuint64 total = 0;
+		for (unsigned int i = 0; i < next; i++)
+		{
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &nanoseconds);
+			total += nanoseconds;
+		}
+		return total / (double)next * 1e-6;
+	}
+
+	void Reset() { next = 0; }
+
+private:
+	vector<GLuint> queries;
+	unsigned int next = 0;
+};
+#endif
@@ -0,0 +1,148 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <cyMatrix.h>
+#include "UniformBuffer.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+using namespace std;
+
+/*
+* Bins point lights into a grid of view space clusters: TILES_X x TILES_Y screen tiles, each split into SLICES depth
+* slices spaced exponentially between near and far so every slice has a similar shape. Build runs on the CPU once
+* per frame; the lighting pass finds the cluster of a pixel from its screen position and view depth and only loops
+* over that cluster's lights.
+*
+* The output is in the layout of the storage blocks of lighting_pass.frag: per cluster an (offset, count) pair into
+* one flat list of light indices. Clusters are ordered x fastest, then y, then slice.
+*/
+class LightClusters
+{
+public:
+	static const unsigned int TILES_X = 16, TILES_Y = 9, SLICES = 24;
+	static const unsigned int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+	static const unsigned int MAX_LIGHT_INDICES = 64 * 1024;
+
+	// lights are in view space with their radius in position[3]
+	void Build(const vector<PointLight>& lights, const cyMatrix4f& projection, float nearDepth, float farDepth)
+	{
+		near = nearDepth;
+		far = farDepth;
+		sliceScale = SLICES / log(far / near);
+		lightCount = (unsigned int)lights.size();
+
+		ranges.resize(lights.size());
+		clusters.assign(CLUSTER_COUNT * 2, 0);
+
+		// count the lights of every cluster
+		for (size_t i = 0; i < lights.size(); i++)
+		{
+			ranges[i] = GetRange(lights[i], projection);
+			ForEachCluster(ranges[i], [&](unsigned int cluster) { clusters[cluster * 2 + 1]++; });
+		}
+
+		// turn counts into offsets, dropping whatever doesn't fit the index list
+		limits.resize(CLUSTER_COUNT);
+		unsigned int offset = 0;
+		for (unsigned int cluster = 0; cluster < CLUSTER_COUNT; cluster++)
+		{
+			limits[cluster] = std::min(clusters[cluster * 2 + 1], MAX_LIGHT_INDICES - offset);
+			clusters[cluster * 2] = offset;
+			clusters[cluster * 2 + 1] = 0;
+			offset += limits[cluster];
+		}
+
+		// fill in the indices
+		lightIndices.resize(std::max(offset, 1u));
+		for (size_t i = 0; i < lights.size(); i++)
+		{
+			ForEachCluster(ranges[i], [&](unsigned int cluster) {
+				unsigned int& count = clusters[cluster * 2 + 1];
+				if (count < limits[cluster]) lightIndices[clusters[cluster * 2] + count++] = (unsigned int)i;
+			});
+		}
+	}
+
+	// (offset, count) pairs, two per cluster
+	const vector<unsigned int>& GetClusters() const { return clusters; }
+	const vector<unsigned int>& GetLightIndices() const { return lightIndices; }
+
+	ClusterUniforms GetUniforms() const
+	{
+		ClusterUniforms uniforms = { { TILES_X, TILES_Y, SLICES, lightCount }, { near, sliceScale, far, 0.0f } };
+		return uniforms;
+	}
+
+private:
+	struct Range
+	{
+		int x0, x1, y0, y1, z0, z1;	// inclusive, empty when x0 > x1
+	};
+
+	float near = 0.1f, far = 100.0f, sliceScale = 1.0f;
+	unsigned int lightCount = 0;
+	vector<Range> ranges;
+	vector<unsigned int> clusters, limits, lightIndices;
+
+	int GetSlice(float depth) const
+	{
+		return std::min(std::max((int)floor(log(depth / near) * sliceScale), 0), (int)SLICES - 1);
+	}
+
+	// clusters overlapped by the light's bounding box
+	Range GetRange(const PointLight& light, const cyMatrix4f& projection) const
+	{
+		Range range = { 0, -1, 0, -1, 0, -1 };
+
+		float radius = light.position[3];
+		float depthNear = -light.position[2] - radius;
+		float depthFar = -light.position[2] + radius;
+		if (depthFar < near || depthNear > far) return range;
+
+		range.z0 = GetSlice(std::max(depthNear, near));
+		range.z1 = GetSlice(std::min(depthFar, far));
+
+		// a box crossing the near plane can cover any part of the screen
+		range.x0 = range.y0 = 0;
+		range.x1 = TILES_X - 1;
+		range.y1 = TILES_Y - 1;
+		if (depthNear <= near) return range;
+
+		// project the corners of the box. The projection is symmetric, so x and y only need the diagonal.
+		float minX = 1.0f, maxX = -1.0f, minY = 1.0f, maxY = -1.0f;
+		for (int corner = 0; corner < 8; corner++)
+		{
+			float x = light.position[0] + (corner & 1 ? radius : -radius);
+			float y = light.position[1] + (corner & 2 ? radius : -radius);
+			float depth = corner & 4 ? depthFar : depthNear;
+			float ndcX = projection.cell[0] * x / depth;
+			float ndcY = projection.cell[5] * y / depth;
+			minX = std::min(minX, ndcX);
+			maxX = std::max(maxX, ndcX);
+			minY = std::min(minY, ndcY);
+			maxY = std::max(maxY, ndcY);
+		}
+
+		range.x0 = GetTile(minX, TILES_X);
+		range.x1 = GetTile(maxX, TILES_X);
+		range.y0 = GetTile(minY, TILES_Y);
+		range.y1 = GetTile(maxY, TILES_Y);
+		return range;
+	}
+
+	static int GetTile(float ndc, unsigned int tiles)
+	{
+		return std::min(std::max((int)floor((ndc * 0.5f + 0.5f) * tiles), 0), (int)tiles - 1);
+	}
+
+	template <typename Function>
+	static void ForEachCluster(const Range& range, Function function)
+	{
+		for (int z = range.z0; z <= range.z1; z++)
+			for (int y = range.y0; y <= range.y1; y++)
+				for (int x = range.x0; x <= range.x1; x++)
+					function((z * TILES_Y + y) * TILES_X + x);
+	}
+};
+#endif
@@ -4,6 +4,7 @@
 #include <GL/glew.h>
 #include <cyVector.h>
 #include <cyGL.h>
+#include "RingBuffer.h"
 #include <string>
 #include <vector>
 using namespace std;
@@ -27,6 +28,15 @@ struct Vertex {
     float m_Weights[MAX_BONE_INFLUENCE];
 };
 
+// layout consumed by glDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+
 struct Texture {
     unsigned int id;
     string type;
@@ -51,8 +61,9 @@ public:
         setupMesh();
     }
 
-    // render the mesh
-    void Draw(cyGLSLProgram& shader)
+    // render the mesh. When a command buffer is given, the draw is issued indirectly from a command written into it;
+    // the caller binds it to GL_DRAW_INDIRECT_BUFFER once for all the meshes it draws.
+    void Draw(cyGLSLProgram& shader, RingBuffer* commandBuffer = NULL)
     {
         // bind appropriate textures
         unsigned int diffuseNr = 1;
@@ -83,7 +94,22 @@ public:
 
         // draw mesh
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        if (commandBuffer)
+        {
+            RingBuffer::Allocation allocation = commandBuffer->Allocate(sizeof(DrawElementsIndirectCommand), sizeof(GLuint));
+            DrawElementsIndirectCommand* command = (DrawElementsIndirectCommand*)allocation.data;
+            command->count = static_cast<unsigned int>(indices.size());
+            command->instanceCount = 1;
+            command->firstIndex = 0;
+            command->baseVertex = 0;
+            command->baseInstance = 0;
+
+            glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)allocation.offset);
+        }
+        else
+        {
+            glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        }
         glBindVertexArray(0);
 
         // always good practice to set everything back to defaults once configured.
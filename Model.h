@@ -14,6 +14,7 @@
 
 #include "Mesh.h"
 #include "Transformation.h"
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -34,6 +35,7 @@ public:
 	string directory;
 
 	Transformation transformation;
+	unsigned int transformIndex = 0;	// slot in the TransformSystem holding this model's matrices
 	bool invertX;
 	bool invertY;
 	bool invertZ;
@@ -43,14 +45,47 @@ public:
 		loadModel(path, flipUV);
 	}
 
-	// draws the model, and thus all its meshes
-	void Draw(cyGLSLProgram& shader)
+	// draws the model, and thus all its meshes. Every mesh binds its own textures, so each is its own draw.
+	void Draw(cyGLSLProgram& shader, RingBuffer* commandBuffer = NULL)
 	{
+		if (commandBuffer) glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer->id);
 		for (unsigned int i = 0; i < meshes.size(); i++)
-			meshes[i].Draw(shader);
+			meshes[i].Draw(shader, commandBuffer);
+		if (commandBuffer) glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	// draws the positions of all meshes only, for depth-only passes. Nothing differs between the meshes there, so with
+	// a command buffer the whole model is a single glMultiDrawElementsIndirect.
+	void DrawDepth(RingBuffer* commandBuffer = NULL)
+	{
+		if (depthCommands.empty()) return;
+
+		glBindVertexArray(positionVAO);
+		if (commandBuffer)
+		{
+			GLsizeiptr size = depthCommands.size() * sizeof(DrawElementsIndirectCommand);
+			RingBuffer::Allocation allocation = commandBuffer->Allocate(size, sizeof(GLuint));
+			memcpy(allocation.data, &depthCommands[0], size);
+
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer->id);
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)allocation.offset, (GLsizei)depthCommands.size(), 0);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		}
+		else
+		{
+			for (const DrawElementsIndirectCommand& command : depthCommands)
+				glDrawElementsBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+					(void*)(command.firstIndex * sizeof(GLuint)), command.baseVertex);
+		}
+		glBindVertexArray(0);
 	}
 
 private:
+	// tightly packed positions of all meshes in one buffer, so depth-only passes fetch 12 bytes per vertex instead of
+	// a whole Vertex and draw every mesh from the same vertex array. One command per mesh locates it in there.
+	unsigned int positionVAO = 0, positionVBO = 0, positionEBO = 0;
+	vector<DrawElementsIndirectCommand> depthCommands;
+
 	// loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
 	void loadModel(string const& path, bool flipUV)
 	{
@@ -70,6 +105,43 @@ private:
 
 		// process ASSIMP's root node recursively
 		processNode(scene->mRootNode, scene);
+		setupDepthBuffers();
+	}
+
+	// concatenates the positions and indices of every mesh into the position only stream
+	void setupDepthBuffers()
+	{
+		vector<cy::Vec3f> positions;
+		vector<unsigned int> indices;
+		for (const Mesh& mesh : meshes)
+		{
+			DrawElementsIndirectCommand command;
+			command.count = static_cast<unsigned int>(mesh.indices.size());
+			command.instanceCount = 1;
+			command.firstIndex = static_cast<unsigned int>(indices.size());
+			command.baseVertex = static_cast<int>(positions.size());
+			command.baseInstance = 0;
+			depthCommands.push_back(command);
+
+			for (const Vertex& vertex : mesh.vertices) positions.push_back(vertex.Position);
+			indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+		}
+		if (depthCommands.empty()) return;
+
+		glGenVertexArrays(1, &positionVAO);
+		glGenBuffers(1, &positionVBO);
+		glGenBuffers(1, &positionEBO);
+
+		glBindVertexArray(positionVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+		glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(cy::Vec3f), &positions[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, positionEBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(cy::Vec3f), (void*)0);
+
+		glBindVertexArray(0);
+		glDisableVertexAttribArray(0);
 	}
 
 	// processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
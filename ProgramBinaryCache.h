@@ -0,0 +1,163 @@
+#ifndef PROGRAM_BINARY_CACHE_H
+#define PROGRAM_BINARY_CACHE_H
+
+#include <GL/glew.h>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+using namespace std;
+
+/*
+* Stores linked programs on disk with glGetProgramBinary and restores them with glProgramBinary on the next launch.
+*
+* A binary is keyed by a hash of the final (define injected) shader sources together with the GL vendor, renderer and
+* version strings, so editing a shader or updating the driver simply misses the cache. The driver may still reject a
+* binary it produced itself, which shows up as a failed link status once the load completes; the caller then
+* recompiles from source.
+*/
+class ProgramBinaryCache
+{
+public:
+	typedef unsigned long long Key;
+
+	// programs built through each path since startup, and their summed submit to ready latency
+	unsigned int warmCount = 0, coldCount = 0;
+	double warmMilliseconds = 0.0, coldMilliseconds = 0.0;
+
+	void Init(const char* cacheDirectory)
+	{
+		directory = cacheDirectory;
+
+		GLint formats = 0;
+		if (GLEW_ARB_get_program_binary) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		enabled = formats > 0;
+		if (!enabled) return;
+
+#ifdef _WIN32
+		_mkdir(directory.c_str());
+#else
+		mkdir(directory.c_str(), 0755);
+#endif
+
+		driver = string((const char*)glGetString(GL_VENDOR)) + "|" + (const char*)glGetString(GL_RENDERER) + "|" + (const char*)glGetString(GL_VERSION);
+	}
+
+	bool IsEnabled() const { return enabled; }
+
+	// sources of every stage in pipeline order
+	Key GetKey(const vector<string>& sources) const
+	{
+		Key hash = 14695981039346656037ull;
+		hash = Hash(hash, driver);
+		for (size_t i = 0; i < sources.size(); i++)
+		{
+			if (i > 0) hash = Hash(hash, string(1, '\0'));	// keep "ab" + "c" distinct from "a" + "bc"
+			hash = Hash(hash, sources[i]);
+		}
+		return hash;
+	}
+
+	// issues glProgramBinary with the cached binary, returns false on a miss. The link status is not queried here so
+	// the load doesn't block; the caller checks it once the program has completed.
+	bool Load(GLuint program, Key key)
+	{
+		if (!enabled) return false;
+
+		ifstream file(GetPath(key), ios::binary);
+		if (!file) return false;
+
+		Header header;
+		file.read((char*)&header, sizeof(header));
+		if (!file || header.magic != MAGIC || header.key != key || header.length <= 0) return false;
+
+		vector<char> binary(header.length);
+		file.read(&binary[0], header.length);
+		if (!file) return false;
+
+		glProgramBinary(program, header.format, &binary[0], header.length);
+		return true;
+	}
+
+	// writes the binary of a successfully linked program. The program must have been linked with
+	// GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+	void Store(GLuint program, Key key)
+	{
+		if (!enabled) return;
+
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0) return;
+
+		Header header;
+		header.magic = MAGIC;
+		header.key = key;
+		header.length = length;
+
+		vector<char> binary(length);
+		glGetProgramBinary(program, length, NULL, &header.format, &binary[0]);
+
+		ofstream file(GetPath(key), ios::binary | ios::trunc);
+		if (!file)
+		{
+			cout << "ERROR::SHADER_CACHE:: could not write " << GetPath(key) << endl;
+			return;
+		}
+		file.write((const char*)&header, sizeof(header));
+		file.write(&binary[0], length);
+	}
+
+	void PrintStatistics() const
+	{
+		printf("Shader programs: %u warm (binary cache) in %.1f ms, %u cold (compiled from source) in %.1f ms\n",
+			warmCount, warmMilliseconds, coldCount, coldMilliseconds);
+	}
+
+private:
+	static const unsigned int MAGIC = 0x42505353;	// "SSPB"
+
+	struct Header
+	{
+		unsigned int magic;
+		Key key;
+		GLenum format;
+		GLint length;
+	};
+
+	bool enabled = false;
+	string directory;
+	string driver;
+
+	// 64 bit FNV-1a
+	static Key Hash(Key hash, const string& data)
+	{
+		for (unsigned char c : data)
+		{
+			hash ^= c;
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	string GetPath(Key key) const
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.bin", key);
+		return directory + "/" + name;
+	}
+};
+
+// the cache shared by every program built through ProgramBuildQueue
+inline ProgramBinaryCache& GetProgramBinaryCache()
+{
+	static ProgramBinaryCache cache;
+	return cache;
+}
+#endif
@@ -0,0 +1,320 @@
+#ifndef PROGRAM_BUILD_QUEUE_H
+#define PROGRAM_BUILD_QUEUE_H
+
+#include <GL/glew.h>
+#include <cyGL.h>
+#include "ProgramBinaryCache.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// reads a whole shader file, returns an empty string if it can't be opened
+inline string ReadShaderFile(const char* path)
+{
+	ifstream file(path);
+	if (!file)
+	{
+		cout << "ERROR::SHADER:: could not open " << path << endl;
+		return string();
+	}
+	stringstream contents;
+	contents << file.rdbuf();
+	return contents.str();
+}
+
+// replaces every #include "file" line with the contents of file, looked up relative to directory. Shared snippets
+// guard themselves with #ifndef, so including one twice is harmless.
+inline string ResolveIncludes(const string& source, const string& directory, unsigned int depth = 0)
+{
+	if (depth > 8)
+	{
+		cout << "ERROR::SHADER:: #include nested too deeply" << endl;
+		return source;
+	}
+
+	string result;
+	istringstream lines(source);
+	string line;
+	while (getline(lines, line))
+	{
+		size_t directive = line.find_first_not_of(" \t");
+		if (directive != string::npos && line.compare(directive, 8, "#include") == 0)
+		{
+			size_t open = line.find('"', directive);
+			size_t close = open == string::npos ? string::npos : line.find('"', open + 1);
+			if (close != string::npos)
+			{
+				string included = ReadShaderFile((directory + line.substr(open + 1, close - open - 1)).c_str());
+				result += ResolveIncludes(included, directory, depth + 1) + "\n";
+				continue;
+			}
+		}
+		result += line + "\n";
+	}
+	return result;
+}
+
+// inserts defines right after the #version line, which has to stay the first statement of the source
+inline string InjectDefines(const string& source, const string& defines)
+{
+	if (defines.empty()) return source;
+
+	size_t version = source.find("#version");
+	if (version == string::npos) return defines + source;
+
+	size_t lineEnd = source.find('\n', version);
+	if (lineEnd == string::npos) return source + "\n" + defines;
+	return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+}
+
+inline void PrintShaderLog(GLuint shader, const string& name)
+{
+	GLint compiled;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+	if (compiled) return;
+
+	GLint length;
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+	vector<char> log(length + 1, '\0');
+	glGetShaderInfoLog(shader, length, NULL, &log[0]);
+	cout << "ERROR::SHADER:: compiling " << name << endl << &log[0] << endl;
+}
+
+inline void PrintProgramLog(GLuint program, const string& name)
+{
+	GLint length;
+	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+	vector<char> log(length + 1, '\0');
+	glGetProgramInfoLog(program, length, NULL, &log[0]);
+	cout << "ERROR::SHADER:: linking " << name << endl << &log[0] << endl;
+}
+
+/*
+* Builds programs without waiting on the driver. Submit issues the binary load (see ProgramBinaryCache) or the
+* compile and link of a program and returns immediately; no status is queried at that point, since any status query
+* forces the driver to finish the work. Poll later checks GL_COMPLETION_STATUS_KHR, which never blocks, and finishes
+* every program that is done: the link result is checked, the binary is cached and the program's setup function runs
+* so it is ready to be handed to the renderer.
+*
+* With GL_KHR_parallel_shader_compile (or the ARB version) the driver compiles on its own threads while the
+* application keeps loading assets. Without it there is no way to ask without blocking, so Poll does nothing and the
+* renderer's Update waits for everything instead, after every program has at least been submitted.
+*/
+class ProgramBuildQueue
+{
+public:
+	typedef void (*SetupFunction)(cyGLSLProgram& Program);
+
+	void Init()
+	{
+		if (GLEW_KHR_parallel_shader_compile)
+		{
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);	// let the driver pick the number of threads
+			parallel = true;
+		}
+		else if (GLEW_ARB_parallel_shader_compile)
+		{
+			glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+			parallel = true;
+		}
+	}
+
+	// starts building Program from a vertex and fragment shader file with "#define ..." lines prepended to both.
+	// #include "file" lines are resolved relative to the shader's directory first.
+	// setup runs with the program bound once it has linked.
+	bool Submit(cyGLSLProgram& Program, const char* vertexFile, const char* fragmentFile, const string& defines, SetupFunction setup = NULL)
+	{
+		Job job;
+		job.name = fragmentFile;
+		if (!AddStage(job, GL_VERTEX_SHADER, vertexFile, defines) || !AddStage(job, GL_FRAGMENT_SHADER, fragmentFile, defines)) return false;
+		return SubmitJob(Program, job, setup);
+	}
+
+	// same as Submit for a compute program
+	bool SubmitCompute(cyGLSLProgram& Program, const char* computeFile, const string& defines, SetupFunction setup = NULL)
+	{
+		Job job;
+		job.name = computeFile;
+		if (!AddStage(job, GL_COMPUTE_SHADER, computeFile, defines)) return false;
+		return SubmitJob(Program, job, setup);
+	}
+
+	// finishes every program whose build has completed. Never blocks. Returns true once nothing is pending.
+	bool Poll() { return parallel ? Process(false) : IsReady(); }
+
+	// Poll when parallel compile is available, otherwise waits for the pending programs. Used by the renderer, which
+	// can't make progress without them.
+	bool Update() { return Process(!parallel); }
+
+	// blocks until every submitted program is ready
+	void Finish() { Process(true); }
+
+	bool IsReady() const { return jobs.empty(); }
+
+private:
+	struct Stage
+	{
+		GLenum type;
+		string source;
+		GLuint shader;
+	};
+
+	struct Job
+	{
+		cyGLSLProgram* program;
+		string name;
+		vector<Stage> stages;
+		SetupFunction setup;
+		ProgramBinaryCache::Key key;
+		bool fromCache;
+		chrono::high_resolution_clock::time_point start;
+	};
+
+	vector<Job> jobs;
+	bool parallel = false;
+	unsigned int readyCount = 0;
+	chrono::high_resolution_clock::time_point firstSubmit;
+
+	static string GetDirectory(const char* file)
+	{
+		string path(file);
+		size_t slash = path.find_last_of("/\\");
+		return slash == string::npos ? string() : path.substr(0, slash + 1);
+	}
+
+	static bool AddStage(Job& job, GLenum type, const char* file, const string& defines)
+	{
+		Stage stage;
+		stage.type = type;
+		stage.source = ReadShaderFile(file);
+		stage.shader = 0;
+		if (stage.source.empty()) return false;
+
+		stage.source = InjectDefines(ResolveIncludes(stage.source, GetDirectory(file)), defines);
+		job.stages.push_back(stage);
+		return true;
+	}
+
+	bool SubmitJob(cyGLSLProgram& Program, Job& job, SetupFunction setup)
+	{
+		job.program = &Program;
+		job.setup = setup;
+
+		vector<string> sources;
+		for (const Stage& stage : job.stages) sources.push_back(stage.source);
+
+		ProgramBinaryCache& cache = GetProgramBinaryCache();
+		job.key = cache.GetKey(sources);
+		job.start = chrono::high_resolution_clock::now();
+		if (jobs.empty() && readyCount == 0) firstSubmit = job.start;
+
+		Program.CreateProgram();
+		job.fromCache = cache.Load(Program.GetID(), job.key);
+		if (!job.fromCache) StartCompile(job);
+
+		jobs.push_back(job);
+		return true;
+	}
+
+	static void StartCompile(Job& job)
+	{
+		job.fromCache = false;
+		GLuint program = job.program->GetID();
+		for (Stage& stage : job.stages)
+		{
+			stage.shader = glCreateShader(stage.type);
+			const char* source = stage.source.c_str();
+			glShaderSource(stage.shader, 1, &source, NULL);
+			glCompileShader(stage.shader);
+			glAttachShader(program, stage.shader);
+		}
+
+		// linking right away is fine, the driver chains it after the compiles
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(program);
+	}
+
+	bool IsComplete(const Job& job) const
+	{
+		GLint complete = GL_TRUE;
+		glGetProgramiv(job.program->GetID(), GL_COMPLETION_STATUS_KHR, &complete);
+		return complete == GL_TRUE;
+	}
+
+	// returns true when the job is done, false if it had to be restarted from source
+	bool Complete(Job& job)
+	{
+		ProgramBinaryCache& cache = GetProgramBinaryCache();
+		GLuint program = job.program->GetID();
+		double milliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - job.start).count();
+
+		GLint linked;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+		if (job.fromCache)
+		{
+			if (!linked)
+			{
+				// the driver rejected the cached binary, fall back to compiling from source
+				StartCompile(job);
+				return false;
+			}
+			cache.warmCount++;
+			cache.warmMilliseconds += milliseconds;
+		}
+		else
+		{
+			for (Stage& stage : job.stages) glDetachShader(program, stage.shader);
+			if (!linked)
+			{
+				for (Stage& stage : job.stages) PrintShaderLog(stage.shader, job.name);
+				PrintProgramLog(program, job.name);
+				exit(1);	// same as a failed build in CompileShaders
+			}
+			for (Stage& stage : job.stages) glDeleteShader(stage.shader);
+
+			cache.Store(program, job.key);
+			cache.coldCount++;
+			cache.coldMilliseconds += milliseconds;
+		}
+
+		if (job.setup)
+		{
+			job.program->Bind();
+			job.setup(*job.program);
+		}
+		readyCount++;
+		return true;
+	}
+
+	bool Process(bool wait)
+	{
+		if (jobs.empty()) return true;
+
+		for (size_t i = 0; i < jobs.size();)
+		{
+			if ((wait || IsComplete(jobs[i])) && Complete(jobs[i]))
+			{
+				jobs.erase(jobs.begin() + i);
+				continue;
+			}
+			// a job restarted from source is checked again on the next poll
+			if (wait && !jobs[i].fromCache) continue;
+			i++;
+		}
+
+		if (jobs.empty())
+		{
+			GetProgramBinaryCache().PrintStatistics();
+			printf("All %u shader programs ready %.1f ms after the first submit\n", readyCount,
+				chrono::duration<double, milli>(chrono::high_resolution_clock::now() - firstSubmit).count());
+			return true;
+		}
+		return false;
+	}
+};
+#endif
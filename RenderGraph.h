@@ -0,0 +1,377 @@
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include <GL/glew.h>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+// FNV-1a over the raw bytes of everything a cached pass's output depends on
+class Fingerprint
+{
+public:
+	Fingerprint& Add(const void* data, size_t size)
+	{
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 1099511628211ull;
+		return *this;
+	}
+
+	template <typename T>
+	Fingerprint& Add(const T& value) { return Add(&value, sizeof(T)); }
+
+	uint64_t Get() const { return hash; }
+
+private:
+	uint64_t hash = 14695981039346656037ull;
+};
+
+/*
+* The passes of one frame, each declaring the textures it reads and the targets it writes. Compile culls every pass
+* whose outputs no surviving pass reads, working back from the passes that write an output resource (the window) or
+* are kept alive for their side effects. A transient target only lives from the first pass writing it to the last
+* pass reading it; transients of the same format and size whose lifetimes don't overlap share one texture. The
+* textures are pooled across frames and the pool only grows, so a frame with the same passes as the last one creates
+* no GL objects. Imported resources (the gBuffer, histories, the window) are never aliased.
+*
+* Execute binds the framebuffer of each pass's first output with the viewport set to its size and binds its inputs to
+* their texture units before running it. An input with unit -1 is only a dependency, the pass binds it itself.
+* The graph is rebuilt every frame: Reset, declare resources and passes, Compile, Execute.
+*
+* With caching on, a cached pass is skipped when its outputs still hold what it would render: its fingerprint and the
+* versions of its inputs match the last run, and no other pass has written its targets since. Every pass that runs
+* gives its outputs a new version, so a change reruns exactly the passes after it that depend on it. Transients of a
+* cached pass are kept out of aliasing and hold on to their pooled texture from frame to frame.
+*/
+class RenderGraph
+{
+public:
+	typedef int Resource;
+
+	struct Input
+	{
+		Resource resource;
+		int unit;
+	};
+
+	void Reset()
+	{
+		resources.clear();
+		passes.clear();
+	}
+
+	Resource CreateTransient(const char* name, GLenum format, int width, int height)
+	{
+		ResourceEntry resource = { name, format, width, height, true, false, -1, 0, 0 };
+		resources.push_back(resource);
+		return (Resource)resources.size() - 1;
+	}
+
+	// framebuffer may be 0 for the window or for a texture no pass renders to through the graph
+	Resource Import(const char* name, GLuint texture, GLuint framebuffer, int width, int height, bool output = false)
+	{
+		ResourceEntry resource = { name, GL_NONE, width, height, false, output, -1, texture, framebuffer };
+		resources.push_back(resource);
+		return (Resource)resources.size() - 1;
+	}
+
+	void AddPass(const char* name, const vector<Input>& inputs, const vector<Resource>& outputs, function<void()> execute,
+		bool keepAlive = false)
+	{
+		Pass pass = { name, inputs, outputs, execute, keepAlive, false, 0, false, false };
+		passes.push_back(pass);
+	}
+
+	// a pass whose output only depends on its inputs and on what went into fingerprint. Never kept alive, anything
+	// with side effects has to be an ordinary pass.
+	void AddCachedPass(const char* name, const vector<Input>& inputs, const vector<Resource>& outputs, uint64_t fingerprint,
+		function<void()> execute)
+	{
+		Pass pass = { name, inputs, outputs, execute, false, true, fingerprint, false, false };
+		passes.push_back(pass);
+	}
+
+	// cached passes run like ordinary ones while caching is off
+	void SetCaching(bool enabled)
+	{
+		if (!enabled) cache.clear();
+		caching = enabled;
+	}
+
+	// forgets every cached output, e.g. when an imported target a cached pass writes is recreated
+	void Invalidate() { cache.clear(); }
+
+	// culls, assigns the transients to pooled textures and decides which cached passes can be skipped. Returns true
+	// if new textures had to be created. With printStats it also prints what survived and how much was pooled.
+	bool Compile(bool printStats = false)
+	{
+		// passes are declared in execution order, so one sweep from the back sees every reader before its writer
+		vector<bool> needed(resources.size(), false);
+		for (size_t i = passes.size(); i-- > 0;)
+		{
+			Pass& pass = passes[i];
+			pass.alive = pass.keepAlive;
+			for (Resource output : pass.outputs)
+				if (needed[output] || resources[output].output) pass.alive = true;
+			if (!pass.alive) continue;
+			for (const Input& input : pass.inputs) needed[input.resource] = true;
+		}
+
+		// lifetime of every transient, in pass indices
+		vector<int> firstUse(resources.size(), -1), lastUse(resources.size(), -1);
+		for (int i = 0; i < (int)passes.size(); i++)
+		{
+			if (!passes[i].alive) continue;
+			for (Resource output : passes[i].outputs)
+			{
+				if (firstUse[output] < 0) firstUse[output] = i;
+				lastUse[output] = i;
+			}
+			for (const Input& input : passes[i].inputs) lastUse[input.resource] = i;
+		}
+
+		// outputs of cached passes first: they keep a texture of their own for the whole frame, the one they had before
+		// if it is free
+		for (PooledTarget& target : pool) target.busyUntil = -1;
+		bool created = false;
+		unsigned int transients = 0;
+		for (const Pass& pass : passes)
+		{
+			if (!pass.alive || !pass.cached || !caching) continue;
+			for (Resource output : pass.outputs)
+			{
+				if (!resources[output].transient || resources[output].texture != 0) continue;
+				created |= Assign(output, 0, INT_MAX);
+				transients++;
+			}
+		}
+
+		// then the others in order of first use, reusing any texture whose last owner is done by then
+		for (int i = 0; i < (int)passes.size(); i++)
+		{
+			for (Resource output : passes[i].outputs)
+			{
+				const ResourceEntry& resource = resources[output];
+				if (!resource.transient || firstUse[output] != i || resource.texture != 0) continue;
+				created |= Assign(output, i, lastUse[output]);
+				transients++;
+			}
+		}
+
+		// a cached pass runs when its fingerprint or an input changed or its targets were overwritten; every pass that
+		// runs moves its outputs to a new version
+		unsigned int skipped = 0;
+		for (Pass& pass : passes)
+		{
+			if (!pass.alive) continue;
+
+			vector<uint64_t> inputVersions;
+			for (const Input& input : pass.inputs) inputVersions.push_back(versions[resources[input.resource].name]);
+			vector<GLuint> outputTextures;
+			for (Resource output : pass.outputs) outputTextures.push_back(resources[output].texture);
+
+			pass.run = true;
+			if (pass.cached && caching)
+			{
+				map<string, CacheEntry>::const_iterator entry = cache.find(pass.name);
+				pass.run = entry == cache.end() || entry->second.fingerprint != pass.fingerprint ||
+					entry->second.inputVersions != inputVersions || entry->second.outputTextures != outputTextures ||
+					!HoldsOutputs(pass);
+			}
+			if (!pass.run)
+			{
+				skipped++;
+				continue;
+			}
+
+			for (Resource output : pass.outputs)
+			{
+				versions[resources[output].name] = nextVersion++;
+				if (resources[output].slot >= 0) pool[resources[output].slot].owner = resources[output].name;
+			}
+			if (pass.cached && caching)
+			{
+				CacheEntry entry = { pass.fingerprint, inputVersions, outputTextures };
+				cache[pass.name] = entry;
+			}
+		}
+
+		if (printStats)
+		{
+			unsigned int alivePasses = 0;
+			for (const Pass& pass : passes) alivePasses += pass.alive ? 1 : 0;
+			printf("Render graph: %u of %u passes (%u cached), %u transient targets in %u of %u pooled textures\n",
+				alivePasses, (unsigned int)passes.size(), skipped, transients, CountBusy(), (unsigned int)pool.size());
+		}
+		return created;
+	}
+
+	void Execute()
+	{
+		for (Pass& pass : passes)
+		{
+			if (!pass.alive || !pass.run) continue;
+
+			if (!pass.outputs.empty())
+			{
+				const ResourceEntry& target = resources[pass.outputs[0]];
+				glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+				glViewport(0, 0, target.width, target.height);
+			}
+			for (const Input& input : pass.inputs)
+			{
+				if (input.unit < 0) continue;
+				glActiveTexture(GL_TEXTURE0 + input.unit);
+				glBindTexture(GL_TEXTURE_2D, resources[input.resource].texture);
+			}
+
+			pass.execute();
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	// 0 for a transient that was culled
+	GLuint GetTexture(Resource resource) const { return resources[resource].texture; }
+	GLuint GetFramebuffer(Resource resource) const { return resources[resource].framebuffer; }
+
+	vector<GLuint> GetPooledFramebuffers() const
+	{
+		vector<GLuint> framebuffers;
+		for (const PooledTarget& target : pool) framebuffers.push_back(target.framebuffer);
+		return framebuffers;
+	}
+
+	// deletes the pooled textures, e.g. when the render size changes
+	void Release()
+	{
+		for (PooledTarget& target : pool)
+		{
+			glDeleteTextures(1, &target.texture);
+			glDeleteFramebuffers(1, &target.framebuffer);
+		}
+		pool.clear();
+		cache.clear();
+		Reset();
+	}
+
+private:
+	struct ResourceEntry
+	{
+		string name;
+		GLenum format;
+		int width, height;
+		bool transient, output;
+		int slot;	// pooled texture of a transient, -1 before assignment and for imported resources
+		GLuint texture, framebuffer;
+	};
+
+	struct Pass
+	{
+		string name;
+		vector<Input> inputs;
+		vector<Resource> outputs;
+		function<void()> execute;
+		bool keepAlive, cached;
+		uint64_t fingerprint;
+		bool alive, run;
+	};
+
+	struct PooledTarget
+	{
+		GLenum format;
+		int width, height;
+		GLuint texture, framebuffer;
+		int busyUntil;	// last pass index of this frame using it, -1 when free
+		string owner;	// resource whose contents it holds
+	};
+
+	// what a cached pass's outputs were rendered from
+	struct CacheEntry
+	{
+		uint64_t fingerprint;
+		vector<uint64_t> inputVersions;
+		vector<GLuint> outputTextures;
+	};
+
+	vector<ResourceEntry> resources;
+	vector<Pass> passes;
+	vector<PooledTarget> pool;
+
+	bool caching = false;
+	map<string, CacheEntry> cache;	// by pass name
+	map<string, uint64_t> versions;	// by resource name, 0 until a pass writes it
+	uint64_t nextVersion = 1;
+
+	// gives a transient a free pooled texture of its format and size, preferring the one still holding its contents,
+	// and keeps it busy until pass busyUntil. Returns true if the texture had to be created.
+	bool Assign(Resource output, int firstUse, int busyUntil)
+	{
+		ResourceEntry& resource = resources[output];
+		size_t slot = pool.size();
+		for (size_t i = 0; i < pool.size(); i++)
+		{
+			const PooledTarget& target = pool[i];
+			if (target.busyUntil >= firstUse || target.format != resource.format || target.width != resource.width ||
+				target.height != resource.height) continue;
+			if (slot == pool.size() || target.owner == resource.name) slot = i;
+			if (target.owner == resource.name) break;
+		}
+
+		bool created = slot == pool.size();
+		if (created) pool.push_back(CreateTarget(resource.format, resource.width, resource.height));
+
+		pool[slot].busyUntil = busyUntil;
+		resource.slot = (int)slot;
+		resource.texture = pool[slot].texture;
+		resource.framebuffer = pool[slot].framebuffer;
+		return created;
+	}
+
+	// whether no other resource has been written into the pass's pooled targets since it last ran
+	bool HoldsOutputs(const Pass& pass) const
+	{
+		for (Resource output : pass.outputs)
+		{
+			const ResourceEntry& resource = resources[output];
+			if (resource.slot >= 0 && pool[resource.slot].owner != resource.name) return false;
+		}
+		return true;
+	}
+
+	unsigned int CountBusy() const
+	{
+		unsigned int busy = 0;
+		for (const PooledTarget& target : pool) busy += target.busyUntil >= 0 ? 1 : 0;
+		return busy;
+	}
+
+	static PooledTarget CreateTarget(GLenum format, int width, int height)
+	{
+		PooledTarget target = { format, width, height, 0, 0, -1, string() };
+
+		glGenTextures(1, &target.texture);
+		glBindTexture(GL_TEXTURE_2D, target.texture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		glGenFramebuffers(1, &target.framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.texture, 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			cout << "ERROR::RENDER_GRAPH:: incomplete framebuffer for a transient target" << endl;
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		return target;
+	}
+};
+#endif
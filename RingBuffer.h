@@ -0,0 +1,105 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <GL/glew.h>
+#include <cstdio>
+#include <cstdlib>
+
+/*
+* A persistently mapped buffer split into FRAMES equally sized segments. Every frame sub-allocates its dynamic data
+* (uniform blocks, light lists, indirect draw commands) linearly out of one segment and writes it straight through the
+* mapped pointer. A fence is placed behind the frame's commands, and the segment is only handed out again once that
+* fence has signaled, so the CPU never overwrites data the GPU may still be reading and never stalls on the
+* driver to upload it.
+*/
+class RingBuffer
+{
+public:
+	static const unsigned int FRAMES = 3;
+
+	struct Allocation
+	{
+		void* data;
+		GLintptr offset;	// offset from the start of the buffer object, used for binding and indirect draws
+	};
+
+	GLuint id = 0;
+
+	bool Create(GLsizeiptr bytesPerFrame)
+	{
+		if (!GLEW_ARB_buffer_storage) return false;
+
+		segmentSize = bytesPerFrame;
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		glGenBuffers(1, &id);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+		glBufferStorage(GL_COPY_WRITE_BUFFER, segmentSize * FRAMES, NULL, flags);
+		mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, segmentSize * FRAMES, flags);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		GLint alignment;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		uniformAlignment = alignment;
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		storageAlignment = alignment;
+
+		return mapped != NULL;
+	}
+
+	// waits until the GPU is done with the segment this frame is about to reuse
+	void BeginFrame()
+	{
+		segment = (segment + 1) % FRAMES;
+		if (fences[segment])
+		{
+			GLenum status = glClientWaitSync(fences[segment], 0, 0);
+			while (status == GL_TIMEOUT_EXPIRED)
+			{
+				status = glClientWaitSync(fences[segment], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+			}
+			glDeleteSync(fences[segment]);
+			fences[segment] = 0;
+		}
+		head = 0;
+	}
+
+	// marks the end of the commands reading the current segment
+	void EndFrame()
+	{
+		fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	Allocation Allocate(GLsizeiptr size, GLsizeiptr alignment)
+	{
+		GLsizeiptr start = ((head + alignment - 1) / alignment) * alignment;
+		if (start + size > segmentSize)
+		{
+			fprintf(stderr, "Ring buffer segment of %d bytes exhausted.", (int)segmentSize);
+			exit(1);
+		}
+		head = start + size;
+
+		Allocation allocation;
+		allocation.offset = segment * segmentSize + start;
+		allocation.data = mapped + allocation.offset;
+		return allocation;
+	}
+
+	Allocation AllocateUniforms(GLsizeiptr size) { return Allocate(size, uniformAlignment); }
+	Allocation AllocateStorage(GLsizeiptr size) { return Allocate(size, storageAlignment); }
+
+	void BindRange(GLenum target, GLuint binding, GLintptr offset, GLsizeiptr size) { glBindBufferRange(target, binding, id, offset, size); }
+
+	GLsizeiptr GetUniformAlignment() const { return uniformAlignment; }
+
+private:
+	unsigned char* mapped = NULL;
+	GLsizeiptr segmentSize = 0;
+	GLsizeiptr uniformAlignment = 256;
+	GLsizeiptr storageAlignment = 256;
+	GLsizeiptr head = 0;
+	unsigned int segment = 0;
+	GLsync fences[FRAMES] = {};
+};
+#endif
@@ -0,0 +1,187 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <cyVector.h>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+using namespace std;
+
+// how the SSAO kernel spreads its samples over the hemisphere
+enum KernelPattern { KERNEL_RANDOM, KERNEL_HALTON, KERNEL_FIBONACCI, KERNEL_PATTERN_COUNT };
+
+inline const char* GetKernelPatternName(KernelPattern pattern)
+{
+	const char* names[KERNEL_PATTERN_COUNT] = { "random", "halton", "fibonacci" };
+	return names[pattern];
+}
+
+// index mirrored around the radix point in the given base, the van der Corput sequence
+inline float RadicalInverse(unsigned int base, unsigned int index)
+{
+	float inverseBase = 1.0f / base;
+	float factor = inverseBase;
+	float result = 0.0f;
+	while (index > 0)
+	{
+		result += (index % base) * factor;
+		index /= base;
+		factor *= inverseBase;
+	}
+	return result;
+}
+
+/*
+* count points of the unit hemisphere around +z, at distances from the center that favour the center. Sample i
+* belongs to subset i % subsets, and each subset is a well spread kernel of its own; SSAO passes that only take every
+* subsets-th sample (temporal and adaptive sampling) rely on this.
+*
+* KERNEL_RANDOM is the original white noise kernel. KERNEL_HALTON gives each subset a contiguous run of the 2, 3, 5
+* Halton sequence, whose runs are evenly spread by construction. KERNEL_FIBONACCI gives each subset a Fibonacci spiral
+* with its own offset, so together the subsets cover every height stratum of the hemisphere once.
+*/
+inline vector<cyVec3f> GenerateKernel(unsigned int count, KernelPattern pattern, unsigned int subsets)
+{
+	const float PI = 3.14159265358979f;
+	const float INVERSE_GOLDEN_RATIO = 0.61803398875f;
+
+	uniform_real_distribution<float> randomFloats(0.0f, 1.0f);
+	default_random_engine generator;
+
+	subsets = max(1u, min(subsets, count));
+	unsigned int subsetSize = count / subsets;
+
+	vector<cyVec3f> kernel;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		unsigned int subset = i % subsets;
+		unsigned int k = i / subsets;
+
+		// u: height above the tangent plane, v: angle around the normal, w: distance from the center
+		float u, v, w;
+		if (pattern == KERNEL_HALTON)
+		{
+			unsigned int index = subset * subsetSize + k + 1;	// index 0 is the origin in every base
+			u = RadicalInverse(2, index);
+			v = RadicalInverse(3, index);
+			w = RadicalInverse(5, index);
+		}
+		else if (pattern == KERNEL_FIBONACCI)
+		{
+			float offset = (subset + 0.5f) / subsets;
+			u = (k + offset) / subsetSize;
+			v = fmod(k * INVERSE_GOLDEN_RATIO + (float)subset / subsets, 1.0f);
+			w = fmod(RadicalInverse(2, k) + offset / subsetSize, 1.0f);	// bit reversed, so it doesn't follow the height
+		}
+		else
+		{
+			// the original kernel: directions from a half cube, pushed outwards with the index
+			cyVec3f sample(randomFloats(generator) * 2.0f - 1.0f, randomFloats(generator) * 2.0f - 1.0f, randomFloats(generator));
+			sample.Normalize();
+			sample *= randomFloats(generator);
+			float scale = float(i) / count;
+			scale = 0.1f + scale * scale * (1.0f - 0.1f);	// same operations as the original lerp, bit for bit
+			kernel.push_back(sample * scale);
+			continue;
+		}
+
+		// uniform over the hemisphere, then pulled towards the center
+		float z = u;
+		float r = sqrt(max(0.0f, 1.0f - z * z));
+		float distance = 0.1f + 0.9f * w * w;
+		kernel.push_back(cyVec3f(r * cos(2.0f * PI * v), r * sin(2.0f * PI * v), z) * distance);
+	}
+	return kernel;
+}
+
+/*
+* Ulichney's void and cluster method: ranks every pixel of a size x size torus so that the pixels below any rank are
+* spread as evenly as possible, with no low frequencies. Returns (rank + 0.5) / (size * size) row by row.
+*/
+inline vector<float> GenerateBlueNoise(unsigned int size, unsigned int seed = 1)
+{
+	const float SIGMA = 1.5f;
+	unsigned int count = size * size;
+
+	// energy a pixel adds to every other, by toroidal offset
+	vector<float> gaussian(count);
+	for (unsigned int y = 0; y < size; y++)
+	{
+		for (unsigned int x = 0; x < size; x++)
+		{
+			float dx = (float)min(x, size - x), dy = (float)min(y, size - y);
+			gaussian[y * size + x] = exp(-(dx * dx + dy * dy) / (2.0f * SIGMA * SIGMA));
+		}
+	}
+
+	vector<unsigned char> pattern(count, 0);
+	vector<float> energy(count, 0.0f);
+	auto toggle = [&](unsigned int pixel, float sign) {
+		pattern[pixel] = sign > 0.0f;
+		unsigned int px = pixel % size, py = pixel / size;
+		for (unsigned int y = 0; y < size; y++)
+			for (unsigned int x = 0; x < size; x++)
+				energy[y * size + x] += sign * gaussian[((y + size - py) % size) * size + (x + size - px) % size];
+	};
+	// the set pixel with the most energy around it, or the empty one with the least
+	auto tightestCluster = [&]() {
+		unsigned int best = count;
+		for (unsigned int i = 0; i < count; i++)
+			if (pattern[i] && (best == count || energy[i] > energy[best])) best = i;
+		return best;
+	};
+	auto largestVoid = [&]() {
+		unsigned int best = count;
+		for (unsigned int i = 0; i < count; i++)
+			if (!pattern[i] && (best == count || energy[i] < energy[best])) best = i;
+		return best;
+	};
+
+	// initial pattern: a tenth of the pixels at random, relaxed by moving the tightest cluster into the largest void
+	// until that no longer changes anything
+	mt19937 generator(seed);
+	unsigned int ones = max(1u, count / 10);
+	for (unsigned int placed = 0; placed < ones;)
+	{
+		unsigned int pixel = generator() % count;
+		if (pattern[pixel]) continue;
+		toggle(pixel, 1.0f);
+		placed++;
+	}
+	for (;;)
+	{
+		unsigned int cluster = tightestCluster();
+		toggle(cluster, -1.0f);
+		unsigned int gap = largestVoid();
+		toggle(gap, 1.0f);
+		if (gap == cluster) break;
+	}
+
+	vector<unsigned char> prototype = pattern;
+	vector<float> prototypeEnergy = energy;
+	vector<unsigned int> rank(count);
+
+	// ranks below the initial pattern: remove its tightest clusters one by one
+	for (unsigned int r = ones; r-- > 0;)
+	{
+		unsigned int cluster = tightestCluster();
+		toggle(cluster, -1.0f);
+		rank[cluster] = r;
+	}
+
+	// ranks above: starting from the initial pattern again, fill the largest voids one by one
+	pattern = prototype;
+	energy = prototypeEnergy;
+	for (unsigned int r = ones; r < count; r++)
+	{
+		unsigned int gap = largestVoid();
+		toggle(gap, 1.0f);
+		rank[gap] = r;
+	}
+
+	vector<float> noise(count);
+	for (unsigned int i = 0; i < count; i++) noise[i] = (rank[i] + 0.5f) / count;
+	return noise;
+}
+#endif
@@ -0,0 +1,90 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <GL/glew.h>
+#include <cyGL.h>
+#include "ProgramBuildQueue.h"
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+/*
+* Every combination of a small set of boolean features of one vertex/fragment shader pair, compiled up front as
+* separate programs. Each feature becomes a #define, so the shaders can drop the branches of disabled features at
+* compile time instead of testing bool uniforms per fragment. Constants (e.g. a kernel size) shared by all variants
+* are passed as extra define lines. The variant to draw with is picked by its feature bit mask. Features that exclude
+* each other would leave most combinations unused, so Build can take a filter of the masks the renderer can reach and
+* skips the rest.
+*/
+class ShaderVariants
+{
+public:
+	typedef bool (*MaskFilter)(unsigned int featureMask);
+
+	// submits every variant, or only those reachable passes, to queue; they are ready to use once the queue has drained
+	bool Build(ProgramBuildQueue& queue, const char* vertexFile, const char* fragmentFile, const vector<string>& featureNames,
+		const string& constants = string(), ProgramBuildQueue::SetupFunction setup = NULL, MaskFilter reachable = NULL)
+	{
+		// programs own GL objects, so they are held by pointer and never copied. Unreachable masks stay empty.
+		programs.clear();
+		for (size_t mask = 0; mask < ((size_t)1 << featureNames.size()); mask++)
+			programs.push_back(unique_ptr<cyGLSLProgram>(!reachable || reachable((unsigned int)mask) ? new cyGLSLProgram() : NULL));
+
+		for (unsigned int mask = 0; mask < programs.size(); mask++)
+		{
+			if (!programs[mask]) continue;
+			if (!queue.Submit(*programs[mask], vertexFile, fragmentFile, GetDefines(featureNames, mask) + constants, setup))
+			{
+				cout << "ERROR::SHADER:: failed to build variant " << mask << " of " << fragmentFile << endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// same as Build for a compute shader
+	bool BuildCompute(ProgramBuildQueue& queue, const char* computeFile, const vector<string>& featureNames,
+		const string& constants = string(), ProgramBuildQueue::SetupFunction setup = NULL)
+	{
+		programs.clear();
+		for (size_t i = 0; i < ((size_t)1 << featureNames.size()); i++)
+			programs.push_back(unique_ptr<cyGLSLProgram>(new cyGLSLProgram()));
+
+		for (unsigned int mask = 0; mask < programs.size(); mask++)
+		{
+			if (!queue.SubmitCompute(*programs[mask], computeFile, GetDefines(featureNames, mask) + constants, setup))
+			{
+				cout << "ERROR::SHADER:: failed to build variant " << mask << " of " << computeFile << endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	cyGLSLProgram& Get(unsigned int featureMask)
+	{
+		if (!programs[featureMask])
+		{
+			cout << "ERROR::SHADER:: variant " << featureMask << " was filtered out as unreachable" << endl;
+			exit(1);
+		}
+		return *programs[featureMask];
+	}
+
+	// whether the variant was built, false for masks the filter passed to Build rejected
+	bool Has(unsigned int featureMask) const { return programs[featureMask] != NULL; }
+	unsigned int Count() const { return (unsigned int)programs.size(); }
+
+	static string GetDefines(const vector<string>& featureNames, unsigned int mask)
+	{
+		string defines;
+		for (unsigned int i = 0; i < featureNames.size(); i++)
+			if (mask & (1u << i)) defines += "#define " + featureNames[i] + "\n";
+		return defines;
+	}
+
+private:
+	vector<unique_ptr<cyGLSLProgram>> programs;
+};
+#endif
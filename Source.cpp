@@ -11,48 +11,227 @@
 #include "Model.h"
 #include "Scene.h"
 #include "Transformation.h"
-
+#include "TransformSystem.h"
+#include "UniformBuffer.h"
+#include "RingBuffer.h"
+#include "LightClusters.h"
+#include "ShaderVariants.h"
+#include "GpuTimer.h"
+#include "Sampling.h"
+#include "RenderGraph.h"
+
+#include <algorithm>
 #include <random>
 
-#define WINDOW_HEIGHT 1080
-#define WINDOW_WIDTH 1920
 #define PI 3.14159265358979323846
 #define DEG2RAD(degrees) (degrees * PI / 180.0)
 
+// window size, and the internal resolution every offscreen target is rendered at (window size * renderScale)
+int windowWidth = 1920, windowHeight = 1080;
+int renderWidth = 0, renderHeight = 0;
+float renderScale = 1.0f;
+const float MIN_RENDER_SCALE = 0.5f, MAX_RENDER_SCALE = 2.0f, RENDER_SCALE_STEP = 0.25f;
+
 unsigned int lightIndex = 0;
 const cyVec3f lightColors[3]{ cyVec3f(0.5, 0.5, 0.5), cyVec3f(0.2, 0.2, 0.7), cyVec3f(0.7, 0.2, 0.2) };
 
 const unsigned int NUM_SAMPLES = 64;
 
+// SSAO kernel and rotation noise: the kernel is uploaded to every SSAO program, the noise is either a 4x4 tile of
+// random rotations or a BLUE_NOISE_SIZE square tile of blue noise rotations
+enum NoisePattern { NOISE_WHITE, NOISE_BLUE };
+KernelPattern kernelPattern = KERNEL_RANDOM;
+NoisePattern noisePattern = NOISE_WHITE;
+const unsigned int BLUE_NOISE_SIZE = 32;
+std::vector<cyVec3f> ssaoKernel;
+bool sampleKernelPending = false;	// regenerated while programs were still building, uploaded once they are all ready
+
+// many lights mode: point lights placed inside the cube, shaded through view space clusters on top of the main light
+bool manyLightsOn = false;
+const unsigned int MAX_POINT_LIGHTS = 1024;
+unsigned int pointLightCount = 256;
+std::vector<PointLight> pointLights;	// cube model space, radius in position[3]
+LightClusters lightClusters;
+const float CLUSTER_FAR_DEPTH = 50.0f;
+
 bool ambientOcclusionOn, ssaoBlurOn, attenuationOn = false;
+bool depthPrePassOn = false;
+bool compactGBufferOn = false;
+
+// coverage mask: the geometry pass sets the stencil of every pixel it draws, and the full resolution SSAO output, the
+// blur and the lighting pass only shade pixels with the stencil set. Those passes sample gDepth, so they test a copy
+// of its stencil in coverageStencil, which only exists while the mask is on.
+bool coverageMaskOn = false;
+GLuint coverageStencilFBO, coverageStencil;
+
+// SSAO runs at 1 / ssaoResolutionDivisor of the render resolution in each dimension (1, 2 or 4)
+unsigned int ssaoResolutionDivisor = 1;
+int ssaoWidth, ssaoHeight;
+
+// AO estimator: the hemisphere kernel of ssao.frag or horizon_ao.frag with HORIZON_SLICES x HORIZON_STEPS x 2 fetches
+enum AOTechnique { AO_KERNEL, AO_HORIZON };
+AOTechnique aoTechnique = AO_KERNEL;
+const unsigned int HORIZON_SLICES = 2, HORIZON_STEPS = 4;
+
+// the benchmark compares both techniques against ao_reference.frag, which marches REFERENCE_DIRECTIONS^2 rays of
+// REFERENCE_STEPS steps per pixel
+bool aoBenchmarkRequested = false, samplingBenchmarkRequested = false;
+const unsigned int AO_BENCHMARK_RUNS = 100;
+const unsigned int REFERENCE_DIRECTIONS = 16, REFERENCE_STEPS = 8;
+GpuTimer aoTimer;
+
+// the sampling benchmark passes a pattern at TEMPORAL_SAMPLES when its blurred error is at most this factor above the
+// original random kernel with white noise at NUM_SAMPLES
+const double SAMPLING_EQUIVALENCE_TOLERANCE = 1.05;
+
+// temporal SSAO: each frame takes TEMPORAL_SAMPLES of the kernel at a new rotation and blends them into the history
+// reprojected from the previous frame. Two history targets are swapped every frame.
+bool temporalSSAOOn = false;
+const unsigned int TEMPORAL_SAMPLES = 16;
+unsigned int ssaoFrameIndex = 0;
+GLuint ssaoHistoryFBO[2], ssaoHistory[2], ssaoHistoryDepth[2];
+unsigned int ssaoHistoryIndex = 0;	// the history written last
+bool ssaoHistoryValid = false;
+cyMatrix4f previousViewProjection;
+
+// checkerboard SSAO: the full resolution kernel pass for one colour of a checkerboard per frame, alternating, into a
+// half width target. The other colour is rebuilt from the depth weighted neighbours and the reprojected result of the
+// previous frame, which is kept with its depth in two history targets swapped every frame.
+bool checkerboardSSAOOn = false;
+GLuint checkerboardHalfFBO, checkerboardHalfOcclusion;
+GLuint checkerboardFBO[2], checkerboardHistory[2];	// ssaoColorBuffer plus the history as a second target
+unsigned int checkerboardIndex = 0;	// the history written last
+bool checkerboardHistoryValid = false;
+cyMatrix4f checkerboardViewProjection;
+
+// compute shader SSAO: the full resolution kernel pass as TILE_SIZE x TILE_SIZE workgroups sharing a padded depth tile
+bool computeSSAOOn = false;
+const unsigned int SSAO_TILE_SIZE = 16, SSAO_TILE_PADDING = 16;
+
+// adaptive SSAO: samples are taken in batches until the estimate converges, up to a budget set by the projected
+// kernel size. On request the SSAO pass counts the pixels per number of batches into sampleHistogramBuffer.
+bool adaptiveSSAOOn = false;
+const unsigned int ADAPTIVE_BATCH = 8;
+GLuint sampleHistogramBuffer;
+bool sampleHistogramRequested = false;
+
+// world space radius of the SSAO kernel
+const float SSAO_RADIUS = 0.5f;
+
+// multi-scale AO: the kernel at AO_SCALES resolutions, each half the one before with twice the radius and sampling
+// only the shell beyond the previous radius. Scale 0 runs at full resolution on the gBuffer, the coarser ones on their
+// own downsampled depth and normals; ssao_multiscale.frag multiplies them together into ssaoColorBuffer.
+bool multiScaleAOOn = false;
+const unsigned int AO_SCALES = 3;
+const float MULTI_SCALE_BASE_RADIUS = 0.25f;
+GLuint aoScaleDownsampleFBO[AO_SCALES], aoScaleDepth[AO_SCALES], aoScaleNormal[AO_SCALES];
+GLuint aoScaleFBO[AO_SCALES], aoScaleOcclusion[AO_SCALES];
+
+// deinterleaved SSAO: depth split into 4x4 quarter resolution layers, each computed with one noise rotation
+bool deinterleavedSSAOOn = false;
+const unsigned int SSAO_LAYERS = 16;
+GLuint ssaoDeinterleavedDepth, ssaoDeinterleaveFBO[2];
+GLuint ssaoDeinterleavedOcclusion, ssaoDeinterleavedFBO[SSAO_LAYERS];
+std::vector<cyVec3f> ssaoNoise;	// the 4x4 random rotations, row by row
+
+// linear depth mip chain SSAO samples from when depthPyramidOn, one framebuffer per level
+bool depthPyramidOn = false;
+const unsigned int DEPTH_PYRAMID_LEVELS = 6;
+GLuint depthPyramid, depthPyramidFBO[DEPTH_PYRAMID_LEVELS];
 
 GLuint CubeVAO, QuadVAO;
 
 GLuint gBuffer;
-GLuint gPosition, gNormal, gAlbedo, noiseTexture;
+GLuint gPosition, gNormal, gAlbedo, gDepth, noiseTexture;
+
+// the passes after the geometry pass, rebuilt every frame. The three targets below are its transients: they point at
+// pooled textures for the current frame only, are 0 when their pass was culled and may share one texture.
+RenderGraph renderGraph;
 
+// pass caching: the geometry, SSAO and blur passes are skipped while nothing they depend on changed
+bool passCachingOn = false;
+bool renderGraphStatsRequested = false;
 GLuint ssaoFBO, ssaoColorBuffer;
 GLuint ssaoBlurFBO, ssaoColorBufferBlur;
-
-cyGLSLProgram GeometryPassProgram, SSAO_Program, LightingPassProgram, BlurProgram;
+GLuint ssaoBlurTempFBO, ssaoColorBufferBlurTemp;	// the horizontal pass of the separable blur
+
+// taps on each side of the center in both passes of the bilateral blur
+int ssaoBlurRadius = 2;
+const int MAX_BLUR_RADIUS = 8;
+
+// fused blur: only the pass across writes a target, the lighting pass blurs down as it reads the occlusion
+bool fusedBlurOn = false;
+
+// reduced resolution SSAO: downsampled linear depth and normals, and the occlusion computed from them
+GLuint ssaoDownsampleFBO, ssaoDepthLowRes, ssaoNormalLowRes;
+GLuint ssaoLowResFBO, ssaoColorBufferLowRes;
+
+// lit image at render resolution, upscaled into the window when the two differ
+GLuint sceneFBO, sceneColorBuffer;
+
+cyGLSLProgram DepthPrePassProgram;
+
+// feature bits of the shader permutations, in the order their names are passed to ShaderVariants::Build
+enum GeometryPassFeatures { GEOMETRY_READ_TEXTURE = 1 << 0, GEOMETRY_INVERTED_NORMALS = 1 << 1, GEOMETRY_COMPACT_GBUFFER = 1 << 2 };
+enum SSAOFeatures {
+	SSAO_COMPACT_GBUFFER = 1 << 0, SSAO_DOWNSAMPLED_GBUFFER = 1 << 1, SSAO_DEPTH_PYRAMID = 1 << 2, SSAO_DEINTERLEAVED = 1 << 3, SSAO_TEMPORAL = 1 << 4,
+	SSAO_ADAPTIVE = 1 << 5, SSAO_CHECKERBOARD = 1 << 6
+};
+enum LightingPassFeatures {
+	LIGHTING_AMBIENT_OCCLUSION = 1 << 0, LIGHTING_ATTENUATION = 1 << 1, LIGHTING_COMPACT_GBUFFER = 1 << 2, LIGHTING_MANY_LIGHTS = 1 << 3,
+	LIGHTING_FUSED_BLUR = 1 << 4
+};
+enum DepthLinearizeFeatures { DEPTH_LINEARIZE_COMPACT_GBUFFER = 1 << 0 };
+ShaderVariants GeometryPassVariants, SSAOVariants, SSAODownsampleVariants, SSAOUpsampleVariants, LightingPassVariants;
+ShaderVariants DepthLinearizeVariants, SSAODeinterleaveVariants, HorizonAOVariants, AOReferenceVariants, SSAOTemporalVariants;
+ShaderVariants SSAOComputeVariants, SSAOMultiScaleVariants, SSAOCheckerboardVariants, BlurVariants;
+cyGLSLProgram DepthDownsampleProgram, SSAOReinterleaveProgram;
+ProgramBuildQueue shaderQueue;
 
 ClientState client;
 
-Transformation CubeTransformation, QuadTransformation;
+Transformation CubeTransformation;
+unsigned int CubeTransformIndex;
 Model* TerrariumModel, * TeapotModel, * BackpackModel, * StairModel, * DoorModel, * AmeModel, * ObjectModel;
 std::vector<Model*> scene;
+TransformSystem transforms;
+
+// per-frame dynamic data: frame/object/light uniform blocks and indirect draw commands
+RingBuffer dynamicBuffer;
+const GLsizeiptr DYNAMIC_BUFFER_FRAME_SIZE = 1024 * 1024;
+GLsizeiptr objectUniformStride;
+GLintptr objectUniformOffset;
 
 // Render delcarations
-void RenderCube(cyGLSLProgram& p, Transformation& t);
-void RenderQuad(cyGLSLProgram& p, Transformation& t);
+void RenderCube(cyGLSLProgram& p, unsigned int transformIndex);
+void RenderQuad(cyGLSLProgram& p);
+void RenderSceneGeometry(bool depthOnly);
+void BuildDepthPyramid();
+void RenderDeinterleavedSSAO();
+void RenderMultiScaleAO();
+void RenderCheckerboardSSAO();
+void RenderSSAO();
+void DispatchComputeSSAO();
+void ResolveTemporalSSAO();
+cyGLSLProgram& GetAOProgram(unsigned int layout, float radius = SSAO_RADIUS, float innerRadius = 0.0f);
+unsigned int GetAOFetches();
+void PrintSampleHistogram();
+void RenderBlurPass(int pass);
+void BlurSSAO(GLuint occlusion);
+void RunSamplingBenchmark();
+void RunAOBenchmark();
+std::vector<float> ReadOcclusion(GLuint framebuffer);
+double GetRMSE(const std::vector<float>& values, const std::vector<float>& reference);
 
 // GLUT callback delcarations
 void MouseAction(int b, int s, int x, int y);
 void MouseMove(int x, int y);
+void Reshape(int width, int height);
 void KeyboardAction(unsigned char k, int x, int y);
 void SpecialInput(int k, int x, int y);
 void Idle();
 static void RenderSceneCB();
+void BuildRenderGraph();
 
 // Helper method declarations
 void Init();
@@ -60,22 +239,40 @@ void Init(char** argv);
 
 void InitializeGlutCallBacks();
 bool InitGBuffer();
-cyMatrix4f GetModelViewProjection(Transformation t);
-cyMatrix4f GetModelViewTransformation(Transformation t);
+void DeleteGBuffer();
+void ResizeRenderTargets();
+void RegisterTransformations();
+cyMatrix4f GetViewMatrix();
+cyMatrix4f GetProjectionMatrix();
+void CreateUniformBuffers();
+void UpdateFrameUniforms();
+void UpdateObjectUniforms();
+void UpdateLightUniforms();
+void GeneratePointLights();
+void UpdatePointLights();
+void BindObjectUniforms(unsigned int transformIndex);
 static void CompileShaders();
 float GetRelativeDisplacement(Transformation ob1, Transformation ob2, float displacementAmt);
 void CreateQuadVAO();
 void CreateCubeVAO();
 bool CreateRenderBuffer();
-std::vector<cyVec3f> GenerateSampleKernel(unsigned int num_samples);
-void GenerateNoiseTexture(unsigned int num_samples);
+void DeleteRenderBuffer();
+bool CreateSceneColorBuffer();
+bool CreateCoverageStencil();
+void AttachCoverageStencil();
+void DeleteCoverageStencil();
+void DeleteSceneColorBuffer();
+bool CreateDepthPyramid();
+void DeleteDepthPyramid();
+void UploadSampleKernel();
+void GenerateNoiseTexture();
 
 int main(int argc, char** argv) {
 	glutInit(&argc, argv);
 
 	// window initialization
 	glutInitContextFlags(GLUT_DEBUG);
-	glutInitWindowSize(WINDOW_WIDTH, WINDOW_HEIGHT);
+	glutInitWindowSize(windowWidth, windowHeight);
 	glutInitWindowPosition(100, 100);
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
 	glutCreateWindow("Final Project");
@@ -113,6 +310,7 @@ void InitializeGlutCallBacks()
 	glutDisplayFunc(RenderSceneCB);
 	glutMouseFunc(MouseAction);
 	glutMotionFunc(MouseMove);
+	glutReshapeFunc(Reshape);
 	glutKeyboardFunc(KeyboardAction);
 	glutSpecialFunc(SpecialInput);
 }
@@ -122,23 +320,18 @@ void Init(char** argv)
 	CompileShaders();
 
 	ObjectModel = new Model(argv[1], false);
+	shaderQueue.Poll();
 	ObjectModel->transformation.SetScale(0.25f);
 	scene.push_back(ObjectModel);
 	CubeTransformation.SetScale(2.0f);
+	RegisterTransformations();
+	CreateUniformBuffers();
 
-	// SSAO setup
-	if (!CreateRenderBuffer())
-	{
-		fprintf(stderr, "Error initializing SSAO frame buffer object");
-		exit(1);
-	}
-
-	if (!InitGBuffer()) {
-		fprintf(stderr, "Error initializing gBuffer.");
-		exit(1);
-	}
+	// gBuffer, SSAO and scene color targets at the initial window size
+	ResizeRenderTargets();
 
-	GenerateNoiseTexture(NUM_SAMPLES);
+	GenerateNoiseTexture();
+	GeneratePointLights();
 
 	// setup for hard-coded models
 	CreateCubeVAO();
@@ -153,11 +346,17 @@ void Init()
 
 	// Load models
 	TerrariumModel = new Model("resources/ame_terrarium/scene.gltf");
+	shaderQueue.Poll();
 	TeapotModel = new Model("resources/teapot/teapot.obj");
+	shaderQueue.Poll();
 	BackpackModel = new Model("resources/backpack/backpack.obj", false);
+	shaderQueue.Poll();
 	StairModel = new Model("resources/staircase/scene.gltf");
+	shaderQueue.Poll();
 	DoorModel = new Model("resources/wooden_door/scene.gltf");
+	shaderQueue.Poll();
 	AmeModel = new Model("resources/ame/scene.gltf");
+	shaderQueue.Poll();
 
 	// Place model in world space according to scene
 	CubeTransformation.SetScale(2.0f);
@@ -196,117 +395,345 @@ void Init()
 	scene.push_back(StairModel);
 	scene.push_back(DoorModel);
 	scene.push_back(AmeModel);
+	RegisterTransformations();
+	CreateUniformBuffers();
 
-	// SSAO setup
-	if (!CreateRenderBuffer())
+	// gBuffer, SSAO and scene color targets at the initial window size
+	ResizeRenderTargets();
+
+	GenerateNoiseTexture();
+	GeneratePointLights();
+
+	// setup for hard-coded models
+	CreateCubeVAO();
+	CreateQuadVAO();
+
+	glEnable(GL_DEPTH_TEST);
+}
+
+void RegisterTransformations()
+{
+	for (Model* model : scene)
 	{
-		fprintf(stderr, "Error initializing SSAO frame buffer object");
-		exit(1);
+		model->transformIndex = transforms.Add(&model->transformation);
 	}
+	CubeTransformIndex = transforms.Add(&CubeTransformation);
+}
 
-	if (!InitGBuffer()) {
-		fprintf(stderr, "Error initializing gBuffer.");
+void CreateUniformBuffers()
+{
+	if (!dynamicBuffer.Create(DYNAMIC_BUFFER_FRAME_SIZE))
+	{
+		fprintf(stderr, "Error initializing persistently mapped buffer (GL_ARB_buffer_storage required).");
 		exit(1);
 	}
 
-	GenerateNoiseTexture(NUM_SAMPLES);
+	// every object gets its own slot so a draw only has to move the bound range
+	objectUniformStride = AlignUp(sizeof(ObjectUniforms), dynamicBuffer.GetUniformAlignment());
 
-	// setup for hard-coded models
-	CreateCubeVAO();
-	CreateQuadVAO();
+	// one counter per number of adaptive SSAO batches, only touched when a histogram is requested
+	glGenBuffers(1, &sampleHistogramBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, sampleHistogramBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * (NUM_SAMPLES / ADAPTIVE_BATCH), NULL, GL_DYNAMIC_READ);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SAMPLE_HISTOGRAM_STORAGE_BINDING, sampleHistogramBuffer);
+}
 
-	glEnable(GL_DEPTH_TEST);
+static void SetupGeometryPassProgram(cyGLSLProgram& Program)
+{
+	BindUniformBlock(Program, "ObjectData", OBJECT_UNIFORM_BINDING);
 }
 
-static void CompileShaders()
+static void SetupDepthPrePassProgram(cyGLSLProgram& Program)
 {
-	// compile gBuffer shaders
-	if (!GeometryPassProgram.BuildFiles("shaders/geometry_pass.vert", "shaders/geometry_pass.frag")) exit(1);
+	BindUniformBlock(Program, "ObjectData", OBJECT_UNIFORM_BINDING);
+}
 
-	// compile ssao shaders
-	if (!SSAO_Program.BuildFiles("shaders/ssao.vert", "shaders/ssao.frag")) exit(1);
-	SSAO_Program.Bind();
-	SSAO_Program.SetUniform("gPosition", 0);
-	SSAO_Program.SetUniform("gNormal", 1);
-	SSAO_Program.SetUniform("texNoise", 2);
-	SSAO_Program.SetUniform("windowWidth", (float)WINDOW_WIDTH);
-	SSAO_Program.SetUniform("windowHeight", (float)WINDOW_HEIGHT);
+/*
+* The ssao.frag masks GetAOProgram can produce. DOWNSAMPLED_GBUFFER, DEINTERLEAVED and CHECKERBOARD are separate paths
+* of RenderSSAO, so at most one of them is set. The downsampled gBuffer has its own linear depth and never comes with
+* COMPACT_GBUFFER, and DEINTERLEAVED reads its own depth layers instead of the pyramid. DEPTH_PYRAMID, TEMPORAL and
+* ADAPTIVE combine with everything else: 48 of the 128 masks.
+*/
+static bool IsReachableSSAOVariant(unsigned int mask)
+{
+	unsigned int path = mask & (SSAO_DOWNSAMPLED_GBUFFER | SSAO_DEINTERLEAVED | SSAO_CHECKERBOARD);
+	if (path & (path - 1)) return false;
+	if ((mask & SSAO_DOWNSAMPLED_GBUFFER) && (mask & SSAO_COMPACT_GBUFFER)) return false;
+	if ((mask & SSAO_DEINTERLEAVED) && (mask & SSAO_DEPTH_PYRAMID)) return false;
+	return true;
+}
+
+static void SetupSSAOProgram(cyGLSLProgram& Program)
+{
+	// unit 0 holds gPosition or, with a compact gBuffer, gDepth
+	Program.SetUniform("gPosition", 0);
+	Program.SetUniform("gDepth", 0);
+	Program.SetUniform("gNormal", 1);
+	Program.SetUniform("texNoise", 2);
+	Program.SetUniform("depthPyramid", 3);
+	Program.SetUniform("deinterleavedDepth", 4);
+	BindUniformBlock(Program, "FrameData", FRAME_UNIFORM_BINDING);
+	BindStorageBlock(Program, "SampleHistogram", SAMPLE_HISTOGRAM_STORAGE_BINDING);
 
 	// set one time uniforms
-	std::vector<cyVec3f> sampleKernel = GenerateSampleKernel(NUM_SAMPLES);
-	for (unsigned int i = 0; i < NUM_SAMPLES; i++)
-	{
-		std::string locationStr = "samples[" + std::to_string(i) + "]";
+	glUniform3fv(glGetUniformLocation(Program.GetID(), "samples"), NUM_SAMPLES, &ssaoKernel[0].x);
+}
+
+static void SetupHorizonAOProgram(cyGLSLProgram& Program)
+{
+	Program.SetUniform("gPosition", 0);
+	Program.SetUniform("gDepth", 0);
+	Program.SetUniform("gNormal", 1);
+	Program.SetUniform("texNoise", 2);
+	BindUniformBlock(Program, "FrameData", FRAME_UNIFORM_BINDING);
+}
+
+static void SetupAOReferenceProgram(cyGLSLProgram& Program)
+{
+	Program.SetUniform("gPosition", 0);
+	Program.SetUniform("gDepth", 0);
+	Program.SetUniform("gNormal", 1);
+	BindUniformBlock(Program, "FrameData", FRAME_UNIFORM_BINDING);
+}
+
+static void SetupSSAODownsampleProgram(cyGLSLProgram& Program)
+{
+	Program.SetUniform("gPosition", 0);
+	Program.SetUniform("gDepth", 0);
+	Program.SetUniform("gNormal", 1);
+	BindUniformBlock(Program, "FrameData", FRAME_UNIFORM_BINDING);
+}
+
+static void SetupSSAOUpsampleProgram(cyGLSLProgram& Program)
+{
+	Program.SetUniform("gPosition", 0);
+	Program.SetUniform("gDepth", 0);
+	Program.SetUniform("lowResDepth", 1);
+	Program.SetUniform("lowResOcclusion", 2);
+	BindUniformBlock(Program, "FrameData", FRAME_UNIFORM_BINDING);
+}
 
-		float buffer[3];
-		sampleKernel[i].Get(buffer);
-		glUniform3fv(glGetUniformLocation(SSAO_Program.GetID(), locationStr.c_str()), 1, buffer);
+static void SetupSSAOMultiScaleProgram(cyGLSLProgram& Program)
+{
+	Program.SetUniform("gPosition", 0);
+	Program.SetUniform("gDepth", 0);
+	Program.SetUniform("fineOcclusion", 1);
+	for (unsigned int i = 0; i + 1 < AO_SCALES; i++)
+	{
+		Program.SetUniform(("coarseDepth[" + std::to_string(i) + "]").c_str(), (int)(2 + i));
+		Program.SetUniform(("coarseOcclusion[" + std::to_string(i) + "]").c_str(), (int)(1 + AO_SCALES + i));
 	}
+	BindUniformBlock(Program, "FrameData", FRAME_UNIFORM_BINDING);
+}
 
+static void SetupDepthLinearizeProgram(cyGLSLProgram& Program)
+{
+	Program.SetUniform("gPosition", 0);
+	Program.SetUniform("gDepth", 0);
+	BindUniformBlock(Program, "FrameData", FRAME_UNIFORM_BINDING);
+}
 
-	float perspective[16];
-	cy::Matrix4f::Perspective(DEG2RAD(45.0f), (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT, 0.1f, 1000.0f).Get(perspective);
-	SSAO_Program.SetUniformMatrix4("projection", perspective);
+static void SetupDepthDownsampleProgram(cyGLSLProgram& Program)
+{
+	Program.SetUniform("previousLevel", 0);
+}
 
-	// compile ssao blur shaders
-	if (!BlurProgram.BuildFiles("shaders/ssao.vert", "shaders/blur.frag")) exit(1);
-	BlurProgram.Bind();
-	BlurProgram.SetUniform("ssaoInput", 0);
+static void SetupSSAODeinterleaveProgram(cyGLSLProgram& Program)
+{
+	Program.SetUniform("gPosition", 0);
+	Program.SetUniform("gDepth", 0);
+	BindUniformBlock(Program, "FrameData", FRAME_UNIFORM_BINDING);
+}
 
-	// compile lighting pass shaders
-	if (!LightingPassProgram.BuildFiles("shaders/ssao.vert", "shaders/lighting_pass.frag")) exit(1);
+static void SetupSSAOReinterleaveProgram(cyGLSLProgram& Program)
+{
+	Program.SetUniform("deinterleavedOcclusion", 0);
+}
 
+static void SetupSSAOTemporalProgram(cyGLSLProgram& Program)
+{
+	Program.SetUniform("gPosition", 0);
+	Program.SetUniform("gDepth", 0);
+	Program.SetUniform("currentOcclusion", 1);
+	Program.SetUniform("historyOcclusion", 2);
+	Program.SetUniform("historyDepth", 3);
+	BindUniformBlock(Program, "FrameData", FRAME_UNIFORM_BINDING);
+}
+
+static void SetupSSAOCheckerboardProgram(cyGLSLProgram& Program)
+{
+	Program.SetUniform("gPosition", 0);
+	Program.SetUniform("gDepth", 0);
+	Program.SetUniform("halfOcclusion", 1);
+	Program.SetUniform("history", 2);
+	BindUniformBlock(Program, "FrameData", FRAME_UNIFORM_BINDING);
+}
+
+static void SetupBlurProgram(cyGLSLProgram& Program)
+{
+	Program.SetUniform("gPosition", 0);
+	Program.SetUniform("gDepth", 0);
+	Program.SetUniform("gNormal", 1);
+	Program.SetUniform("ssaoInput", 2);
+	BindUniformBlock(Program, "FrameData", FRAME_UNIFORM_BINDING);
+}
+
+// FUSED_BLUR only does anything under AMBIENT_OCCLUSION, and BuildRenderGraph never asks for it without
+static bool IsReachableLightingVariant(unsigned int mask)
+{
+	return !(mask & LIGHTING_FUSED_BLUR) || (mask & LIGHTING_AMBIENT_OCCLUSION);
+}
+
+static void SetupLightingPassProgram(cyGLSLProgram& Program)
+{
 	// set texture uniforms
-	LightingPassProgram.Bind();
-	LightingPassProgram.SetUniform("gPosition", 0);
-	LightingPassProgram.SetUniform("gNormal", 1);
-	LightingPassProgram.SetUniform("gAlbedo", 2);
-	LightingPassProgram.SetUniform("ssao", 3);
+	Program.SetUniform("gPosition", 0);
+	Program.SetUniform("gDepth", 0);
+	Program.SetUniform("gNormal", 1);
+	Program.SetUniform("gAlbedo", 2);
+	Program.SetUniform("ssao", 3);
+	BindUniformBlock(Program, "FrameData", FRAME_UNIFORM_BINDING);
+	BindUniformBlock(Program, "LightData", LIGHT_UNIFORM_BINDING);
+	BindUniformBlock(Program, "ClusterData", CLUSTER_UNIFORM_BINDING);
+	BindStorageBlock(Program, "LightList", LIGHT_STORAGE_BINDING);
+	BindStorageBlock(Program, "ClusterList", CLUSTER_STORAGE_BINDING);
+	BindStorageBlock(Program, "LightIndexList", LIGHT_INDEX_STORAGE_BINDING);
+}
+
+// Submits every program to shaderQueue without waiting for any of them. The driver keeps compiling while the models
+// load; each program's setup function runs once shaderQueue.Poll sees it has linked.
+static void CompileShaders()
+{
+	GetProgramBinaryCache().Init("shader_cache");
+	shaderQueue.Init();
+
+	// uploaded by SetupSSAOProgram. Every adaptive batch is a subset, which also makes the temporal subsets good kernels.
+	ssaoKernel = GenerateKernel(NUM_SAMPLES, kernelPattern, NUM_SAMPLES / ADAPTIVE_BATCH);
+
+	// compile gBuffer shaders
+	if (!GeometryPassVariants.Build(shaderQueue, "shaders/geometry_pass.vert", "shaders/geometry_pass.frag",
+		{ "READ_TEXTURE", "INVERTED_NORMALS", "COMPACT_GBUFFER" }, "", SetupGeometryPassProgram)) exit(1);
+
+	// compile depth pre-pass shaders
+	if (!shaderQueue.Submit(DepthPrePassProgram, "shaders/depth_prepass.vert", "shaders/depth_prepass.frag", "", SetupDepthPrePassProgram)) exit(1);
+
+	// compile ssao shaders, the kernel size is baked in as a constant. Only the masks GetAOProgram can ask for.
+	if (!SSAOVariants.Build(shaderQueue, "shaders/ssao.vert", "shaders/ssao.frag",
+		{ "COMPACT_GBUFFER", "DOWNSAMPLED_GBUFFER", "DEPTH_PYRAMID", "DEINTERLEAVED", "TEMPORAL", "ADAPTIVE", "CHECKERBOARD" },
+		"#define KERNEL_SIZE " + std::to_string(NUM_SAMPLES) + "\n#define DEPTH_PYRAMID_LEVELS " + std::to_string(DEPTH_PYRAMID_LEVELS) +
+		"\n#define TEMPORAL_SAMPLES " + std::to_string(TEMPORAL_SAMPLES) + "\n#define ADAPTIVE_BATCH " + std::to_string(ADAPTIVE_BATCH) + "\n",
+		SetupSSAOProgram, IsReachableSSAOVariant)) exit(1);
+	if (!SSAOComputeVariants.BuildCompute(shaderQueue, "shaders/ssao.comp", { "COMPACT_GBUFFER", "TEMPORAL" },
+		"#define KERNEL_SIZE " + std::to_string(NUM_SAMPLES) + "\n#define TEMPORAL_SAMPLES " + std::to_string(TEMPORAL_SAMPLES) +
+		"\n#define TILE_SIZE " + std::to_string(SSAO_TILE_SIZE) + "\n#define TILE_PADDING " + std::to_string(SSAO_TILE_PADDING) + "\n",
+		SetupSSAOProgram)) exit(1);
+	if (!SSAOTemporalVariants.Build(shaderQueue, "shaders/ssao.vert", "shaders/ssao_temporal.frag",
+		{ "COMPACT_GBUFFER" }, "", SetupSSAOTemporalProgram)) exit(1);
+	if (!SSAOCheckerboardVariants.Build(shaderQueue, "shaders/ssao.vert", "shaders/ssao_checkerboard.frag",
+		{ "COMPACT_GBUFFER" }, "", SetupSSAOCheckerboardProgram)) exit(1);
+
+	// compile depth pyramid shaders
+	if (!DepthLinearizeVariants.Build(shaderQueue, "shaders/ssao.vert", "shaders/depth_linearize.frag",
+		{ "COMPACT_GBUFFER" }, "", SetupDepthLinearizeProgram)) exit(1);
+	if (!shaderQueue.Submit(DepthDownsampleProgram, "shaders/ssao.vert", "shaders/depth_downsample.frag", "", SetupDepthDownsampleProgram)) exit(1);
+
+	// compile horizon based ao shaders, and the brute force reference the benchmarks measure against
+	if (!HorizonAOVariants.Build(shaderQueue, "shaders/ssao.vert", "shaders/horizon_ao.frag", { "COMPACT_GBUFFER", "DOWNSAMPLED_GBUFFER" },
+		"#define HORIZON_SLICES " + std::to_string(HORIZON_SLICES) + "\n#define HORIZON_STEPS " + std::to_string(HORIZON_STEPS) + "\n",
+		SetupHorizonAOProgram)) exit(1);
+	if (!AOReferenceVariants.Build(shaderQueue, "shaders/ssao.vert", "shaders/ao_reference.frag", { "COMPACT_GBUFFER" },
+		"#define REFERENCE_DIRECTIONS " + std::to_string(REFERENCE_DIRECTIONS) + "\n#define REFERENCE_STEPS " + std::to_string(REFERENCE_STEPS) + "\n",
+		SetupAOReferenceProgram)) exit(1);
+
+	// compile the passes around reduced resolution ssao
+	if (!SSAODownsampleVariants.Build(shaderQueue, "shaders/ssao.vert", "shaders/ssao_downsample.frag",
+		{ "COMPACT_GBUFFER" }, "", SetupSSAODownsampleProgram)) exit(1);
+	if (!SSAOUpsampleVariants.Build(shaderQueue, "shaders/ssao.vert", "shaders/ssao_upsample.frag",
+		{ "COMPACT_GBUFFER" }, "", SetupSSAOUpsampleProgram)) exit(1);
+	if (!SSAOMultiScaleVariants.Build(shaderQueue, "shaders/ssao.vert", "shaders/ssao_multiscale.frag",
+		{ "COMPACT_GBUFFER" }, "#define AO_SCALES " + std::to_string(AO_SCALES) + "\n", SetupSSAOMultiScaleProgram)) exit(1);
+
+	// compile the passes around deinterleaved ssao
+	if (!SSAODeinterleaveVariants.Build(shaderQueue, "shaders/ssao.vert", "shaders/ssao_deinterleave.frag",
+		{ "COMPACT_GBUFFER" }, "", SetupSSAODeinterleaveProgram)) exit(1);
+	if (!shaderQueue.Submit(SSAOReinterleaveProgram, "shaders/ssao.vert", "shaders/ssao_reinterleave.frag", "", SetupSSAOReinterleaveProgram)) exit(1);
 
-	// set light uniforms
-	LightingPassProgram.SetUniform3("light.Position", &cyVec3f(2.0, 4.0, 6.0)[0]);
+	// compile ssao blur shaders
+	if (!BlurVariants.Build(shaderQueue, "shaders/ssao.vert", "shaders/blur.frag", { "COMPACT_GBUFFER" }, "", SetupBlurProgram)) exit(1);
+
+	// compile lighting pass shaders
+	if (!LightingPassVariants.Build(shaderQueue, "shaders/ssao.vert", "shaders/lighting_pass.frag",
+		{ "AMBIENT_OCCLUSION", "ATTENUATION", "COMPACT_GBUFFER", "MANY_LIGHTS", "FUSED_BLUR" }, "", SetupLightingPassProgram,
+		IsReachableLightingVariant)) exit(1);
 }
 
+/*
+* The full gBuffer stores view space position and normal in two RGBA16F targets. The compact one drops the position,
+* which the passes reconstruct from the depth texture and the inverse projection, and packs the normal into two
+* 16 bit octahedral components. Per pixel that is 12 instead of 24 bytes written by the geometry pass and read by
+* every full screen pass.
+*/
 bool InitGBuffer()
 {
 	glGenFramebuffers(1, &gBuffer);
 	glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
 
+	GLenum attachment = GL_COLOR_ATTACHMENT0;
 
-	glGenTextures(1, &gPosition);
-	glBindTexture(GL_TEXTURE_2D, gPosition);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, WINDOW_WIDTH, WINDOW_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gPosition, 0);
+	if (!compactGBufferOn)
+	{
+		glGenTextures(1, &gPosition);
+		glBindTexture(GL_TEXTURE_2D, gPosition);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, renderWidth, renderHeight, 0, GL_RGBA, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, attachment++, GL_TEXTURE_2D, gPosition, 0);
+	}
 
 
 	glGenTextures(1, &gNormal);
 	glBindTexture(GL_TEXTURE_2D, gNormal);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, WINDOW_WIDTH, WINDOW_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
+	if (compactGBufferOn)
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16_SNORM, renderWidth, renderHeight, 0, GL_RG, GL_FLOAT, NULL);
+	else
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, renderWidth, renderHeight, 0, GL_RGBA, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormal, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, attachment++, GL_TEXTURE_2D, gNormal, 0);
 
 
 	glGenTextures(1, &gAlbedo);
 	glBindTexture(GL_TEXTURE_2D, gAlbedo);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, WINDOW_WIDTH, WINDOW_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, renderWidth, renderHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, gAlbedo, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, attachment++, GL_TEXTURE_2D, gAlbedo, 0);
 
 
 	GLuint attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
-	glDrawBuffers(3, attachments);
+	glDrawBuffers(attachment - GL_COLOR_ATTACHMENT0, attachments);
+
+	// depth is a texture rather than a renderbuffer so the compact layout can sample it. Its stencil holds the
+	// coverage mask; sampling a depth stencil texture returns the depth.
+	glGenTextures(1, &gDepth);
+	glBindTexture(GL_TEXTURE_2D, gDepth);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH32F_STENCIL8, renderWidth, renderHeight, 0, GL_DEPTH_STENCIL, GL_FLOAT_32_UNSIGNED_INT_24_8_REV, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, gDepth, 0);
 
-	GLuint rboDepth;
-	glGenRenderbuffers(1, &rboDepth);
-	glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, WINDOW_WIDTH, WINDOW_HEIGHT);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
+	if (compactGBufferOn && glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		// rendering to SNORM formats is optional on some drivers, RG16F holds the [-1, 1] encoding just as well
+		glBindTexture(GL_TEXTURE_2D, gNormal);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, renderWidth, renderHeight, 0, GL_RG, GL_FLOAT, NULL);
+	}
 
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 	{
@@ -319,50 +746,478 @@ bool InitGBuffer()
 	return true;
 }
 
-bool CreateRenderBuffer()
+/*
+* The stencil the masked passes test, a renderbuffer of the gDepth format so the geometry pass can blit its
+* stencil over. gDepth itself can't be attached to their targets: they sample it with the compact layout, and a
+* texture that is both attached and sampled is a feedback loop even if nothing writes it. Does nothing while the
+* mask is off.
+*/
+bool CreateCoverageStencil()
 {
-	glGenFramebuffers(1, &ssaoFBO);
-	glBindFramebuffer(GL_FRAMEBUFFER, ssaoFBO);
+	if (!coverageMaskOn) return true;
 
-	glGenTextures(1, &ssaoColorBuffer);
-	glBindTexture(GL_TEXTURE_2D, ssaoColorBuffer);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, WINDOW_WIDTH, WINDOW_HEIGHT, 0, GL_RED, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ssaoColorBuffer, 0);
+	glGenRenderbuffers(1, &coverageStencil);
+	glBindRenderbuffer(GL_RENDERBUFFER, coverageStencil);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH32F_STENCIL8, renderWidth, renderHeight);
 
+	glGenFramebuffers(1, &coverageStencilFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, coverageStencilFBO);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, coverageStencil);
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 	{
 		return false;
 	}
 
-	glGenFramebuffers(1, &ssaoBlurFBO);
-	glBindFramebuffer(GL_FRAMEBUFFER, ssaoBlurFBO);
+	AttachCoverageStencil();
+	return true;
+}
 
-	glGenTextures(1, &ssaoColorBufferBlur);
-	glBindTexture(GL_TEXTURE_2D, ssaoColorBufferBlur);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, WINDOW_WIDTH, WINDOW_HEIGHT, 0, GL_RED, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ssaoColorBufferBlur, 0);
+// Attaches coverageStencil to the full resolution targets the mask applies to, the render graph's pooled
+// targets and the scene colour buffer. Called whenever one of them is recreated. Without a coverage stencil
+// it detaches instead.
+void AttachCoverageStencil()
+{
+	vector<GLuint> framebuffers = renderGraph.GetPooledFramebuffers();
+	framebuffers.push_back(sceneFBO);
+	for (GLuint framebuffer : framebuffers)
+	{
+		if (framebuffer == 0) continue;
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, coverageStencil);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void DeleteCoverageStencil()
+{
+	glDeleteRenderbuffers(1, &coverageStencil);
+	glDeleteFramebuffers(1, &coverageStencilFBO);
+	coverageStencil = coverageStencilFBO = 0;
+	AttachCoverageStencil();
+}
+
+void DeleteGBuffer()
+{
+	GLuint textures[4] = { gPosition, gNormal, gAlbedo, gDepth };
+	glDeleteTextures(4, textures);	// unused names are 0 and silently ignored
+	glDeleteFramebuffers(1, &gBuffer);
+	gPosition = gNormal = gAlbedo = gDepth = gBuffer = 0;
+	renderGraph.Invalidate();	// the passes writing the gBuffer have to run again
+}
+
+bool CreateRenderBuffer()
+{
+	ssaoWidth = (renderWidth + ssaoResolutionDivisor - 1) / ssaoResolutionDivisor;
+	ssaoHeight = (renderHeight + ssaoResolutionDivisor - 1) / ssaoResolutionDivisor;
+
+	if (deinterleavedSSAOOn)
+	{
+		int layerWidth = (renderWidth + 3) / 4;
+		int layerHeight = (renderHeight + 3) / 4;
+
+		// quarter resolution depth layers, written eight at a time
+		glGenTextures(1, &ssaoDeinterleavedDepth);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, ssaoDeinterleavedDepth);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R32F, layerWidth, layerHeight, SSAO_LAYERS, 0, GL_RED, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		glGenFramebuffers(2, ssaoDeinterleaveFBO);
+		for (unsigned int half = 0; half < 2; half++)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, ssaoDeinterleaveFBO[half]);
+
+			GLenum attachments[8];
+			for (unsigned int i = 0; i < 8; i++)
+			{
+				attachments[i] = GL_COLOR_ATTACHMENT0 + i;
+				glFramebufferTextureLayer(GL_FRAMEBUFFER, attachments[i], ssaoDeinterleavedDepth, 0, half * 8 + i);
+			}
+			glDrawBuffers(8, attachments);
+
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			{
+				return false;
+			}
+		}
+
+		// occlusion of every layer, one framebuffer per layer
+		glGenTextures(1, &ssaoDeinterleavedOcclusion);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, ssaoDeinterleavedOcclusion);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, layerWidth, layerHeight, SSAO_LAYERS, 0, GL_RED, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glGenFramebuffers(SSAO_LAYERS, ssaoDeinterleavedFBO);
+		for (unsigned int layer = 0; layer < SSAO_LAYERS; layer++)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, ssaoDeinterleavedFBO[layer]);
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, ssaoDeinterleavedOcclusion, 0, layer);
+
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			{
+				return false;
+			}
+		}
+	}
+
+	if (temporalSSAOOn)
+	{
+		// accumulated occlusion with its frame count, and the depth it belongs to, twice to read one while writing the other
+		glGenFramebuffers(2, ssaoHistoryFBO);
+		glGenTextures(2, ssaoHistory);
+		glGenTextures(2, ssaoHistoryDepth);
+		for (unsigned int i = 0; i < 2; i++)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, ssaoHistoryFBO[i]);
+
+			glBindTexture(GL_TEXTURE_2D, ssaoHistory[i]);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, renderWidth, renderHeight, 0, GL_RG, GL_FLOAT, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ssaoHistory[i], 0);
+
+			glBindTexture(GL_TEXTURE_2D, ssaoHistoryDepth[i]);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, renderWidth, renderHeight, 0, GL_RED, GL_FLOAT, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, ssaoHistoryDepth[i], 0);
+
+			GLuint attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+			glDrawBuffers(2, attachments);
+
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			{
+				return false;
+			}
+		}
+		ssaoHistoryValid = false;
+	}
+
+	if (checkerboardSSAOOn)
+	{
+		// one checkerboard colour, every row squeezed to half the width
+		glGenFramebuffers(1, &checkerboardHalfFBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, checkerboardHalfFBO);
+
+		glGenTextures(1, &checkerboardHalfOcclusion);
+		glBindTexture(GL_TEXTURE_2D, checkerboardHalfOcclusion);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, (renderWidth + 1) / 2, renderHeight, 0, GL_RED, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, checkerboardHalfOcclusion, 0);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			return false;
+		}
+
+		// the reconstruction writes ssaoColorBuffer and, for the next frame, occlusion with linear depth. ssaoColorBuffer
+		// is attached every frame, it is a render graph transient.
+		glGenFramebuffers(2, checkerboardFBO);
+		glGenTextures(2, checkerboardHistory);
+		for (unsigned int i = 0; i < 2; i++)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, checkerboardFBO[i]);
+
+			glBindTexture(GL_TEXTURE_2D, checkerboardHistory[i]);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, renderWidth, renderHeight, 0, GL_RG, GL_FLOAT, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, checkerboardHistory[i], 0);
+
+			GLuint attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+			glDrawBuffers(2, attachments);
+
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			{
+				return false;
+			}
+		}
+		checkerboardHistoryValid = false;
+	}
+
+	if (multiScaleAOOn)
+	{
+		// occlusion of every scale, and the downsampled linear depth and normals the coarse scales run on
+		glGenFramebuffers(AO_SCALES, aoScaleFBO);
+		glGenTextures(AO_SCALES, aoScaleOcclusion);
+		for (unsigned int scale = 0; scale < AO_SCALES; scale++)
+		{
+			unsigned int divisor = 1 << scale;
+			int width = (renderWidth + divisor - 1) / divisor;
+			int height = (renderHeight + divisor - 1) / divisor;
+
+			if (scale > 0)
+			{
+				glGenFramebuffers(1, &aoScaleDownsampleFBO[scale]);
+				glBindFramebuffer(GL_FRAMEBUFFER, aoScaleDownsampleFBO[scale]);
+
+				glGenTextures(1, &aoScaleDepth[scale]);
+				glBindTexture(GL_TEXTURE_2D, aoScaleDepth[scale]);
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, NULL);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, aoScaleDepth[scale], 0);
+
+				glGenTextures(1, &aoScaleNormal[scale]);
+				glBindTexture(GL_TEXTURE_2D, aoScaleNormal[scale]);
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, width, height, 0, GL_RG, GL_FLOAT, NULL);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, aoScaleNormal[scale], 0);
+
+				GLuint attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+				glDrawBuffers(2, attachments);
+
+				if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+				{
+					return false;
+				}
+			}
+
+			glBindFramebuffer(GL_FRAMEBUFFER, aoScaleFBO[scale]);
+			glBindTexture(GL_TEXTURE_2D, aoScaleOcclusion[scale]);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_FLOAT, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, aoScaleOcclusion[scale], 0);
+
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			{
+				return false;
+			}
+		}
+	}
+
+	if (ssaoResolutionDivisor > 1)
+	{
+		// downsampled linear depth and octahedral normals, the input of reduced resolution SSAO
+		glGenFramebuffers(1, &ssaoDownsampleFBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, ssaoDownsampleFBO);
+
+		glGenTextures(1, &ssaoDepthLowRes);
+		glBindTexture(GL_TEXTURE_2D, ssaoDepthLowRes);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, ssaoWidth, ssaoHeight, 0, GL_RED, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ssaoDepthLowRes, 0);
+
+		glGenTextures(1, &ssaoNormalLowRes);
+		glBindTexture(GL_TEXTURE_2D, ssaoNormalLowRes);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, ssaoWidth, ssaoHeight, 0, GL_RG, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, ssaoNormalLowRes, 0);
+
+		GLuint attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+		glDrawBuffers(2, attachments);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			return false;
+		}
+
+		// occlusion at the reduced resolution, upsampled into ssaoColorBuffer
+		glGenFramebuffers(1, &ssaoLowResFBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, ssaoLowResFBO);
+
+		glGenTextures(1, &ssaoColorBufferLowRes);
+		glBindTexture(GL_TEXTURE_2D, ssaoColorBufferLowRes);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ssaoWidth, ssaoHeight, 0, GL_RED, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ssaoColorBufferLowRes, 0);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			return false;
+		}
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	return true;
+}
+
+void DeleteRenderBuffer()
+{
+	renderGraph.Release();
+	ssaoColorBuffer = ssaoColorBufferBlur = ssaoColorBufferBlurTemp = ssaoFBO = ssaoBlurFBO = ssaoBlurTempFBO = 0;
+
+	GLuint textures[3] = { ssaoDepthLowRes, ssaoNormalLowRes, ssaoColorBufferLowRes };
+	GLuint framebuffers[2] = { ssaoDownsampleFBO, ssaoLowResFBO };
+	glDeleteTextures(3, textures);
+	glDeleteFramebuffers(2, framebuffers);
+	ssaoDepthLowRes = ssaoNormalLowRes = ssaoColorBufferLowRes = ssaoDownsampleFBO = ssaoLowResFBO = 0;
+
+	GLuint layerTextures[2] = { ssaoDeinterleavedDepth, ssaoDeinterleavedOcclusion };
+	glDeleteTextures(2, layerTextures);
+	glDeleteFramebuffers(2, ssaoDeinterleaveFBO);
+	glDeleteFramebuffers(SSAO_LAYERS, ssaoDeinterleavedFBO);
+	ssaoDeinterleavedDepth = ssaoDeinterleavedOcclusion = 0;
+	for (GLuint& framebuffer : ssaoDeinterleaveFBO) framebuffer = 0;
+	for (GLuint& framebuffer : ssaoDeinterleavedFBO) framebuffer = 0;
+
+	glDeleteTextures(2, ssaoHistory);
+	glDeleteTextures(2, ssaoHistoryDepth);
+	glDeleteFramebuffers(2, ssaoHistoryFBO);
+	for (unsigned int i = 0; i < 2; i++) ssaoHistory[i] = ssaoHistoryDepth[i] = ssaoHistoryFBO[i] = 0;
+
+	glDeleteTextures(1, &checkerboardHalfOcclusion);
+	glDeleteTextures(2, checkerboardHistory);
+	glDeleteFramebuffers(1, &checkerboardHalfFBO);
+	glDeleteFramebuffers(2, checkerboardFBO);
+	checkerboardHalfOcclusion = checkerboardHalfFBO = 0;
+	for (unsigned int i = 0; i < 2; i++) checkerboardHistory[i] = checkerboardFBO[i] = 0;
+
+	glDeleteTextures(AO_SCALES, aoScaleDepth);
+	glDeleteTextures(AO_SCALES, aoScaleNormal);
+	glDeleteTextures(AO_SCALES, aoScaleOcclusion);
+	glDeleteFramebuffers(AO_SCALES, aoScaleDownsampleFBO);
+	glDeleteFramebuffers(AO_SCALES, aoScaleFBO);
+	for (unsigned int i = 0; i < AO_SCALES; i++)
+		aoScaleDepth[i] = aoScaleNormal[i] = aoScaleOcclusion[i] = aoScaleDownsampleFBO[i] = aoScaleFBO[i] = 0;
+}
+
+bool CreateSceneColorBuffer()
+{
+	glGenFramebuffers(1, &sceneFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+
+	glGenTextures(1, &sceneColorBuffer);
+	glBindTexture(GL_TEXTURE_2D, sceneColorBuffer);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, renderWidth, renderHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sceneColorBuffer, 0);
 
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 	{
 		return false;
 	}
 
+	AttachCoverageStencil();
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	return true;
+}
+
+void DeleteSceneColorBuffer()
+{
+	glDeleteTextures(1, &sceneColorBuffer);
+	glDeleteFramebuffers(1, &sceneFBO);
+	sceneColorBuffer = sceneFBO = 0;
+}
+
+bool CreateDepthPyramid()
+{
+	glGenTextures(1, &depthPyramid);
+	glBindTexture(GL_TEXTURE_2D, depthPyramid);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, DEPTH_PYRAMID_LEVELS - 1);
+
+	glGenFramebuffers(DEPTH_PYRAMID_LEVELS, depthPyramidFBO);
+	for (unsigned int level = 0; level < DEPTH_PYRAMID_LEVELS; level++)
+	{
+		int width = std::max(1, renderWidth >> level);
+		int height = std::max(1, renderHeight >> level);
+		glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, NULL);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, depthPyramidFBO[level]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, depthPyramid, level);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			return false;
+		}
+	}
+
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	return true;
 }
 
-void GenerateNoiseTexture(unsigned int num_samples)
+void DeleteDepthPyramid()
+{
+	glDeleteTextures(1, &depthPyramid);
+	glDeleteFramebuffers(DEPTH_PYRAMID_LEVELS, depthPyramidFBO);
+	depthPyramid = 0;
+	for (GLuint& framebuffer : depthPyramidFBO) framebuffer = 0;
+}
+
+// Recreates every offscreen target at the window size scaled by renderScale. Nothing happens if that size is unchanged.
+void ResizeRenderTargets()
+{
+	int width = std::max(1, (int)(windowWidth * renderScale + 0.5f));
+	int height = std::max(1, (int)(windowHeight * renderScale + 0.5f));
+	if (width == renderWidth && height == renderHeight) return;
+
+	renderWidth = width;
+	renderHeight = height;
+
+	DeleteGBuffer();
+	DeleteRenderBuffer();
+	DeleteSceneColorBuffer();
+	DeleteCoverageStencil();
+	DeleteDepthPyramid();
+
+	if (!CreateRenderBuffer())
+	{
+		fprintf(stderr, "Error initializing SSAO frame buffer object");
+		exit(1);
+	}
+
+	if (!InitGBuffer()) {
+		fprintf(stderr, "Error initializing gBuffer.");
+		exit(1);
+	}
+
+	if (!CreateSceneColorBuffer())
+	{
+		fprintf(stderr, "Error initializing scene color frame buffer object");
+		exit(1);
+	}
+
+	if (!CreateCoverageStencil())
+	{
+		fprintf(stderr, "Error initializing coverage stencil frame buffer object");
+		exit(1);
+	}
+
+	if (!CreateDepthPyramid())
+	{
+		fprintf(stderr, "Error initializing depth pyramid frame buffer objects");
+		exit(1);
+	}
+
+	printf("Rendering at %dx%d (%.2fx) for a %dx%d window\n", renderWidth, renderHeight, renderScale, windowWidth, windowHeight);
+}
+
+// The rotations SSAO turns its kernel by per pixel. ssaoNoise always holds the 4x4 random set, which the deinterleaved
+// path uses one layer each; noiseTexture holds the set selected by noisePattern.
+void GenerateNoiseTexture()
 {
 	std::uniform_real_distribution<GLfloat> randomFloats(0.0, 1.0);
 	std::default_random_engine generator;
 
-	std::vector<cyVec3f> ssaoNoise;
-	for (unsigned int i = 0; i < num_samples; i++)
+	ssaoNoise.clear();
+	for (unsigned int i = 0; i < 16; i++)
 	{
 		cyVec3f noise(
 			randomFloats(generator) * 2.0 - 1.0,
@@ -373,22 +1228,57 @@ void GenerateNoiseTexture(unsigned int num_samples)
 		ssaoNoise.push_back(noise);
 	}
 
+	std::vector<cyVec3f> rotations = ssaoNoise;
+	unsigned int size = 4;
+	if (noisePattern == NOISE_BLUE)
+	{
+		// every rank of the blue noise becomes an angle, so neighbouring pixels get rotations far apart
+		std::vector<float> blueNoise = GenerateBlueNoise(BLUE_NOISE_SIZE);
+		size = BLUE_NOISE_SIZE;
+		rotations.clear();
+		for (float rank : blueNoise)
+		{
+			rotations.push_back(cyVec3f(cos(2.0 * PI * rank), sin(2.0 * PI * rank), 0.0f));
+		}
+	}
 
+	glDeleteTextures(1, &noiseTexture);
 	glGenTextures(1, &noiseTexture);
 	glBindTexture(GL_TEXTURE_2D, noiseTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, 4, 4, 0, GL_RGB, GL_FLOAT, &ssaoNoise[0]);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, size, size, 0, GL_RGB, GL_FLOAT, &rotations[0]);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// Set to repeat so that the texture tiles the screen
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 }
 
-void CreateQuadVAO()
+// regenerates ssaoKernel for kernelPattern and hands it to every program built by SetupSSAOProgram. Programs that
+// haven't linked yet can't be bound, so until shaderQueue has finished the upload waits for the first frame after it.
+void UploadSampleKernel()
 {
-	GLuint QuadVBO[2];
-	glGenVertexArrays(1, &QuadVAO);
-	glBindVertexArray(QuadVAO);
-	glGenBuffers(2, QuadVBO);
+	ssaoKernel = GenerateKernel(NUM_SAMPLES, kernelPattern, NUM_SAMPLES / ADAPTIVE_BATCH);
+	sampleKernelPending = !shaderQueue.IsReady();
+	if (sampleKernelPending) return;
+
+	ShaderVariants* variants[2] = { &SSAOVariants, &SSAOComputeVariants };
+	for (ShaderVariants* programs : variants)
+	{
+		for (unsigned int i = 0; i < programs->Count(); i++)
+		{
+			if (!programs->Has(i)) continue;
+			cyGLSLProgram& Program = programs->Get(i);
+			Program.Bind();
+			glUniform3fv(glGetUniformLocation(Program.GetID(), "samples"), NUM_SAMPLES, &ssaoKernel[0].x);
+		}
+	}
+}
+
+void CreateQuadVAO()
+{
+	GLuint QuadVBO[2];
+	glGenVertexArrays(1, &QuadVAO);
+	glBindVertexArray(QuadVAO);
+	glGenBuffers(2, QuadVBO);
 
 	std::vector<cy::Vec3f> vertices = {
 		cyVec3f(-1.0f, 1.0f, 0.0f),
@@ -510,154 +1400,911 @@ static void RenderSceneCB()
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 
-	float mvp_buffer[16];
-	float mv_buffer[16];
+	// programs are handed over as they finish linking; until all of them are ready only the clear is shown
+	if (!shaderQueue.Update())
+	{
+		glutSwapBuffers();
+		return;
+	}
+	if (sampleKernelPending) UploadSampleKernel();
 
-	// Geometry pass. Render into gBuffer
-	glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glBindVertexArray(CubeVAO);
-	GeometryPassProgram.Bind();
-	GeometryPassProgram.SetUniform("readTexture", false);
-	glEnable(GL_CULL_FACE);
-	glCullFace(GL_FRONT);
-	RenderCube(::GeometryPassProgram, ::CubeTransformation);
-	GeometryPassProgram.SetUniform("invertedNormals", false);
-	GetModelViewProjection(::TerrariumModel->transformation).Get(mvp_buffer);
-	GetModelViewTransformation(::TerrariumModel->transformation).Get(mv_buffer);
-	GeometryPassProgram.SetUniform("readTexture", true);
-	GeometryPassProgram.SetUniformMatrix4("mvp", mvp_buffer);
-	GeometryPassProgram.SetUniformMatrix4("mv", mv_buffer);
-	GeometryPassProgram.SetUniform("invertedNormals", false);
-	glCullFace(GL_BACK);
+	// claim this frame's segment of the dynamic buffer; only blocks if the GPU is still reading it from 3 frames ago
+	dynamicBuffer.BeginFrame();
+
+	// camera constants are shared by every pass, so they are uploaded once up front
+	ssaoFrameIndex++;
+	UpdateFrameUniforms();
+
+	// bring every changed object up to date in one batch before any draw reads its matrices
+	transforms.Update(GetViewMatrix(), GetProjectionMatrix());
+	UpdateObjectUniforms();
+	UpdateLightUniforms();
+	if (manyLightsOn)
+	{
+		UpdatePointLights();
+	}
 
-	TerrariumModel->Draw(::GeometryPassProgram);
+	// Every pass except the geometry pass only tests the coverage stencil. Targets without it attached pass every pixel.
+	glStencilMask(0x00);
+	glStencilFunc(GL_EQUAL, 1, 0xFF);
+	coverageMaskOn ? glEnable(GL_STENCIL_TEST) : glDisable(GL_STENCIL_TEST);
 
-	GetModelViewProjection(::AmeModel->transformation).Get(mvp_buffer);
-	GetModelViewTransformation(::AmeModel->transformation).Get(mv_buffer);
-	GeometryPassProgram.SetUniformMatrix4("mvp", mvp_buffer);
-	GeometryPassProgram.SetUniformMatrix4("mv", mv_buffer);
-	AmeModel->Draw(::GeometryPassProgram);
+	glBindVertexArray(QuadVAO);
 
-	GetModelViewProjection(::StairModel->transformation).Get(mvp_buffer);
-	GetModelViewTransformation(::StairModel->transformation).Get(mv_buffer);
-	GeometryPassProgram.SetUniformMatrix4("mvp", mvp_buffer);
-	GeometryPassProgram.SetUniformMatrix4("mv", mv_buffer);
-	StairModel->Draw(::GeometryPassProgram);
+	// only the passes this frame's output depends on run, and with caching only those whose inputs changed
+	BuildRenderGraph();
+	renderGraph.Execute();
 
-	GetModelViewProjection(::DoorModel->transformation).Get(mvp_buffer);
-	GetModelViewTransformation(::DoorModel->transformation).Get(mv_buffer);
-	GeometryPassProgram.SetUniformMatrix4("mvp", mvp_buffer);
-	GeometryPassProgram.SetUniformMatrix4("mv", mv_buffer);
-	DoorModel->Draw(::GeometryPassProgram);
+	glViewport(0, 0, windowWidth, windowHeight);
+	glDisable(GL_STENCIL_TEST);
+	glStencilMask(0xFF);
 
-	glDisable(GL_CULL_FACE);
+	dynamicBuffer.EndFrame();
+	glutSwapBuffers();
+}
 
-	GetModelViewProjection(::BackpackModel->transformation).Get(mvp_buffer);
-	GetModelViewTransformation(::BackpackModel->transformation).Get(mv_buffer);
-	GeometryPassProgram.SetUniformMatrix4("mvp", mvp_buffer);
-	GeometryPassProgram.SetUniformMatrix4("mv", mv_buffer);
-	BackpackModel->Draw(::GeometryPassProgram);
+/*
+* Declares and compiles this frame's passes from the geometry pass to the window, then points the transient
+* globals (ssaoColorBuffer, ssaoColorBufferBlurTemp, ssaoColorBufferBlur and their framebuffers) at the textures
+* the graph assigned them. With ambient occlusion off the SSAO and blur passes are culled, and the fused blur
+* culls the pass down. The benchmarks keep the SSAO pass and every target they use alive.
+*
+* The geometry, SSAO and blur passes are cached. Their fingerprints cover the camera and transforms, the AO
+* settings and the blur settings. Light state only reaches the lighting pass, which runs every frame like the
+* upscale. Temporal and checkerboard SSAO change with every frame, so their frame index is part of the SSAO
+* fingerprint. Pressing y prints how the graph compiled.
+*/
+void BuildRenderGraph()
+{
+	renderGraph.Reset();
+	renderGraph.SetCaching(passCachingOn);
+
+	bool benchmark = aoBenchmarkRequested || samplingBenchmarkRequested || sampleHistogramRequested;
+	bool fuseBlur = fusedBlurOn && ssaoBlurOn && ambientOcclusionOn;
+	bool upscale = renderWidth != windowWidth || renderHeight != windowHeight || coverageMaskOn;
+
+	RenderGraph::Resource depth = renderGraph.Import("gBuffer depth", compactGBufferOn ? gDepth : gPosition, gBuffer, renderWidth, renderHeight);
+	RenderGraph::Resource normal = renderGraph.Import("gBuffer normal", gNormal, 0, renderWidth, renderHeight);
+	RenderGraph::Resource albedo = renderGraph.Import("gBuffer albedo", gAlbedo, 0, renderWidth, renderHeight);
+	RenderGraph::Resource occlusion = renderGraph.CreateTransient("ssao", GL_R8, renderWidth, renderHeight);
+	RenderGraph::Resource blurTemp = renderGraph.CreateTransient("ssao blur temp", GL_R8, renderWidth, renderHeight);
+	RenderGraph::Resource blur = renderGraph.CreateTransient("ssao blur", GL_R8, renderWidth, renderHeight);
+	RenderGraph::Resource scene = renderGraph.Import("scene", sceneColorBuffer, sceneFBO, renderWidth, renderHeight);
+	RenderGraph::Resource window = renderGraph.Import("window", 0, 0, windowWidth, windowHeight, true);
+
+	cyMatrix4f view = GetViewMatrix(), projection = GetProjectionMatrix();
+	Fingerprint geometry;
+	geometry.Add(view.cell, sizeof(view.cell)).Add(projection.cell, sizeof(projection.cell)).Add(compactGBufferOn).Add(coverageMaskOn);
+	for (unsigned int i = 0; i < transforms.Count(); i++) geometry.Add(transforms.GetModel(i), 16 * sizeof(float));
+
+	// Geometry pass. Render into gBuffer, marking every covered pixel in the stencil
+	renderGraph.AddCachedPass("geometry", {}, { depth, normal, albedo }, geometry.Get(), []() {
+		glStencilMask(0xFF);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+		glEnable(GL_STENCIL_TEST);
+		glStencilFunc(GL_ALWAYS, 1, 0xFF);
+		glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+
+		if (depthPrePassOn)
+		{
+			// lay down depth with positions only, then shade each visible pixel exactly once
+			glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+			RenderSceneGeometry(true);
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 
-	GetModelViewProjection(::TeapotModel->transformation).Get(mvp_buffer);
-	GetModelViewTransformation(::TeapotModel->transformation).Get(mv_buffer);
-	GeometryPassProgram.SetUniformMatrix4("mvp", mvp_buffer);
-	GeometryPassProgram.SetUniformMatrix4("mv", mv_buffer);
-	TeapotModel->Draw(::GeometryPassProgram);
+			glDepthFunc(GL_EQUAL);
+			glDepthMask(GL_FALSE);
+		}
 
-	//GetModelViewProjection(::ObjectModel->transformation).Get(mvp_buffer);
-	//GetModelViewTransformation(::ObjectModel->transformation).Get(mv_buffer);
-	//GeometryPassProgram.SetUniformMatrix4("mvp", mvp_buffer);
-	//GeometryPassProgram.SetUniformMatrix4("mv", mv_buffer);
-	//ObjectModel->Draw(::GeometryPassProgram);
+		RenderSceneGeometry(false);
 
-	glBindVertexArray(0);
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
+
+		if (coverageMaskOn)
+		{
+			// the masked passes test this copy, while the stencil mask still lets the blit write it
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, coverageStencilFBO);
+			glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, renderWidth, renderHeight, GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+		}
+
+		// back to testing only, like every other pass
+		glStencilMask(0x00);
+		glStencilFunc(GL_EQUAL, 1, 0xFF);
+		if (!coverageMaskOn) glDisable(GL_STENCIL_TEST);
+		glBindVertexArray(QuadVAO);
+	});
+
+	Fingerprint aoSettings;
+	aoSettings.Add(aoTechnique).Add(kernelPattern).Add(noisePattern).Add(ssaoResolutionDivisor).Add(compactGBufferOn).Add(coverageMaskOn);
+	aoSettings.Add(depthPyramidOn).Add(deinterleavedSSAOOn).Add(multiScaleAOOn).Add(computeSSAOOn).Add(adaptiveSSAOOn);
+	if (temporalSSAOOn || checkerboardSSAOOn) aoSettings.Add(ssaoFrameIndex);
+
+	// the sampling benchmark blurs on its own, so it needs the blur targets whatever the graph does with them
+	vector<RenderGraph::Resource> ssaoOutputs = { occlusion };
+	if (samplingBenchmarkRequested)
+	{
+		ssaoOutputs.push_back(blurTemp);
+		ssaoOutputs.push_back(blur);
+	}
+	function<void()> renderAO = []() {
+		if (sampleHistogramRequested)
+		{
+			std::vector<GLuint> zeros(NUM_SAMPLES / ADAPTIVE_BATCH, 0);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, sampleHistogramBuffer);
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint) * zeros.size(), &zeros[0]);
+		}
+
+		RenderSSAO();
+
+		if (sampleHistogramRequested)
+		{
+			sampleHistogramRequested = false;
+			PrintSampleHistogram();
+		}
+
+		if (aoBenchmarkRequested)
+		{
+			aoBenchmarkRequested = false;
+			RunAOBenchmark();
+		}
+
+		if (samplingBenchmarkRequested)
+		{
+			samplingBenchmarkRequested = false;
+			RunSamplingBenchmark();
+		}
+	};
+	if (benchmark)
+		renderGraph.AddPass("ssao", { { depth, -1 }, { normal, -1 } }, ssaoOutputs, renderAO, true);
+	else
+		renderGraph.AddCachedPass("ssao", { { depth, -1 }, { normal, -1 } }, ssaoOutputs, aoSettings.Get(), renderAO);
+
+	RenderGraph::Resource ssaoResult = occlusion;
+	if (temporalSSAOOn)
+	{
+		unsigned int current = 1 - ssaoHistoryIndex;
+		ssaoResult = renderGraph.Import("ssao history", ssaoHistory[current], ssaoHistoryFBO[current], renderWidth, renderHeight);
+		renderGraph.AddPass("temporal", { { depth, -1 }, { occlusion, -1 } }, { ssaoResult }, []() { ResolveTemporalSSAO(); });
+	}
+
+	// Blur SSAO texture, or only its first pass when the lighting pass finishes it
+	RenderGraph::Resource ao = ssaoResult;
+	if (ssaoBlurOn)
+	{
+		Fingerprint blurSettings;
+		blurSettings.Add(ssaoBlurRadius).Add(compactGBufferOn).Add(coverageMaskOn);
+		renderGraph.AddCachedPass("blur across", { { depth, 0 }, { normal, 1 }, { ssaoResult, 2 } }, { blurTemp }, blurSettings.Get(),
+			[]() { RenderBlurPass(0); });
+		renderGraph.AddCachedPass("blur down", { { depth, 0 }, { normal, 1 }, { blurTemp, 2 } }, { blur }, blurSettings.Get(),
+			[]() { RenderBlurPass(1); });
+		ao = fuseBlur ? blurTemp : blur;
+	}
+
+	// Lighting pass. Goes straight to the window when no rescaling is needed and no mask applies, since the
+	// window has no coverage stencil.
+	vector<RenderGraph::Input> lightingInputs = { { depth, 0 }, { normal, 1 }, { albedo, 2 } };
+	if (ambientOcclusionOn) lightingInputs.push_back({ ao, 3 });
+	renderGraph.AddPass("lighting", lightingInputs, { upscale ? scene : window }, [fuseBlur]() {
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		unsigned int lightingFeatures = (ambientOcclusionOn ? LIGHTING_AMBIENT_OCCLUSION : 0) | (attenuationOn ? LIGHTING_ATTENUATION : 0) |
+			(compactGBufferOn ? LIGHTING_COMPACT_GBUFFER : 0) | (manyLightsOn ? LIGHTING_MANY_LIGHTS : 0) | (fuseBlur ? LIGHTING_FUSED_BLUR : 0);
+		cyGLSLProgram& LightingPassProgram = LightingPassVariants.Get(lightingFeatures);
+		LightingPassProgram.Bind();
+		if (fuseBlur) LightingPassProgram.SetUniform("blurRadius", ssaoBlurRadius);
+
+		RenderQuad(LightingPassProgram);
+	});
+
+	if (upscale)
+	{
+		// Upscale pass. Bilinear resample of the lit image to the window size.
+		renderGraph.AddPass("upscale", { { scene, -1 } }, { window }, []() {
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFBO);
+			glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		});
+	}
+
+	if (renderGraph.Compile(renderGraphStatsRequested)) AttachCoverageStencil();
+	renderGraphStatsRequested = false;
+
+	// the passes read and write the targets through these globals
+	ssaoColorBuffer = renderGraph.GetTexture(occlusion);
+	ssaoFBO = renderGraph.GetFramebuffer(occlusion);
+	ssaoColorBufferBlurTemp = renderGraph.GetTexture(blurTemp);
+	ssaoBlurTempFBO = renderGraph.GetFramebuffer(blurTemp);
+	ssaoColorBufferBlur = renderGraph.GetTexture(blur);
+	ssaoBlurFBO = renderGraph.GetFramebuffer(blur);
+}
+
+/*
+* Writes the view space depth of the gBuffer into level 0 of depthPyramid, then halves it level by level. While a
+* level is written only the level above it is visible to the sampler (base and max level point at it), so the pass
+* never reads the level it renders to.
+*/
+void BuildDepthPyramid()
+{
+	glViewport(0, 0, renderWidth, renderHeight);
+	glBindFramebuffer(GL_FRAMEBUFFER, depthPyramidFBO[0]);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, compactGBufferOn ? gDepth : gPosition);
+	RenderQuad(DepthLinearizeVariants.Get(compactGBufferOn ? DEPTH_LINEARIZE_COMPACT_GBUFFER : 0));
+
+	glBindTexture(GL_TEXTURE_2D, depthPyramid);
+	for (unsigned int level = 1; level < DEPTH_PYRAMID_LEVELS; level++)
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+
+		glViewport(0, 0, std::max(1, renderWidth >> level), std::max(1, renderHeight >> level));
+		glBindFramebuffer(GL_FRAMEBUFFER, depthPyramidFBO[level]);
+		RenderQuad(DepthDownsampleProgram);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, DEPTH_PYRAMID_LEVELS - 1);
+
+	glViewport(0, 0, renderWidth, renderHeight);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Fills ssaoColorBuffer with the selected technique at the selected resolution. Expects the quad VAO to be bound.
+void RenderSSAO()
+{
+	GLuint gBufferDepthSource = compactGBufferOn ? gDepth : gPosition;
+
+	if (depthPyramidOn && aoTechnique == AO_KERNEL)
+	{
+		BuildDepthPyramid();
+		glActiveTexture(GL_TEXTURE3);
+		glBindTexture(GL_TEXTURE_2D, depthPyramid);
+	}
+
+	if (deinterleavedSSAOOn && aoTechnique == AO_KERNEL)
+	{
+		RenderDeinterleavedSSAO();
+	}
+	else if (multiScaleAOOn && aoTechnique == AO_KERNEL)
+	{
+		RenderMultiScaleAO();
+	}
+	else if (ssaoResolutionDivisor > 1)
+	{
+		glViewport(0, 0, ssaoWidth, ssaoHeight);
+
+		// downsample depth and normals to the SSAO resolution
+		glBindFramebuffer(GL_FRAMEBUFFER, ssaoDownsampleFBO);
+		cyGLSLProgram& DownsampleProgram = SSAODownsampleVariants.Get(compactGBufferOn ? SSAO_COMPACT_GBUFFER : 0);
+		DownsampleProgram.Bind();
+		DownsampleProgram.SetUniform("divisor", (int)ssaoResolutionDivisor);
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, gBufferDepthSource);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, gNormal);
+
+		RenderQuad(DownsampleProgram);
+
+		// the AO estimator itself, on a quarter or a sixteenth of the pixels
+		glBindFramebuffer(GL_FRAMEBUFFER, ssaoLowResFBO);
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, ssaoDepthLowRes);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, ssaoNormalLowRes);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, noiseTexture);
+
+		RenderQuad(GetAOProgram(SSAO_DOWNSAMPLED_GBUFFER));
+
+		// back to full resolution, guided by the full resolution depth
+		glViewport(0, 0, renderWidth, renderHeight);
+		glBindFramebuffer(GL_FRAMEBUFFER, ssaoFBO);
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, gBufferDepthSource);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, ssaoDepthLowRes);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, ssaoColorBufferLowRes);
+
+		RenderQuad(SSAOUpsampleVariants.Get(compactGBufferOn ? SSAO_COMPACT_GBUFFER : 0));
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+	else if (checkerboardSSAOOn && aoTechnique == AO_KERNEL)
+	{
+		RenderCheckerboardSSAO();
+	}
+	else if (computeSSAOOn && aoTechnique == AO_KERNEL)
+	{
+		DispatchComputeSSAO();
+	}
+	else
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, ssaoFBO);
+		glClear(GL_COLOR_BUFFER_BIT);
+		cyGLSLProgram& SSAO_Program = GetAOProgram(compactGBufferOn ? SSAO_COMPACT_GBUFFER : 0);
+		SSAO_Program.Bind();
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, gBufferDepthSource);
+
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, gNormal);
+
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, noiseTexture);
+
+		RenderQuad(SSAO_Program);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+}
+
+/*
+* Multi-scale AO into ssaoColorBuffer. Scale s runs the kernel at 1 / 2^s of the render resolution with radius
+* MULTI_SCALE_BASE_RADIUS * 2^s, its samples pushed out beyond half of that, so the finest scale picks up contact
+* occlusion in crevices and the coarsest reaches four times as far out for a sixteenth of the pixels. Takes the place
+* of the reduced resolution option.
+*/
+void RenderMultiScaleAO()
+{
+	GLuint gBufferDepthSource = compactGBufferOn ? gDepth : gPosition;
+	unsigned int gBufferLayout = compactGBufferOn ? SSAO_COMPACT_GBUFFER : 0;
+
+	for (unsigned int scale = 0; scale < AO_SCALES; scale++)
+	{
+		unsigned int divisor = 1 << scale;
+		glViewport(0, 0, (renderWidth + divisor - 1) / divisor, (renderHeight + divisor - 1) / divisor);
+
+		if (scale > 0)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, aoScaleDownsampleFBO[scale]);
+			cyGLSLProgram& DownsampleProgram = SSAODownsampleVariants.Get(gBufferLayout);
+			DownsampleProgram.Bind();
+			DownsampleProgram.SetUniform("divisor", (int)divisor);
+
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, gBufferDepthSource);
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, gNormal);
+
+			RenderQuad(DownsampleProgram);
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, aoScaleFBO[scale]);
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, scale > 0 ? aoScaleDepth[scale] : gBufferDepthSource);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, scale > 0 ? aoScaleNormal[scale] : gNormal);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, noiseTexture);
+
+		RenderQuad(GetAOProgram(scale > 0 ? (unsigned int)SSAO_DOWNSAMPLED_GBUFFER : gBufferLayout,
+			MULTI_SCALE_BASE_RADIUS * divisor, scale > 0 ? 0.5f : 0.0f));
+	}
 
-	// Generate SSAO Texture
+	// combine at full resolution, guided by the full resolution depth
+	glViewport(0, 0, renderWidth, renderHeight);
 	glBindFramebuffer(GL_FRAMEBUFFER, ssaoFBO);
-	glClear(GL_COLOR_BUFFER_BIT);
-	SSAO_Program.Bind();
 
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gPosition);
+	glBindTexture(GL_TEXTURE_2D, gBufferDepthSource);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, aoScaleOcclusion[0]);
+	for (unsigned int scale = 1; scale < AO_SCALES; scale++)
+	{
+		glActiveTexture(GL_TEXTURE1 + scale);
+		glBindTexture(GL_TEXTURE_2D, aoScaleDepth[scale]);
+		glActiveTexture(GL_TEXTURE0 + AO_SCALES + scale);
+		glBindTexture(GL_TEXTURE_2D, aoScaleOcclusion[scale]);
+	}
+
+	RenderQuad(SSAOMultiScaleVariants.Get(gBufferLayout));
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+/*
+* Checkerboard SSAO into ssaoColorBuffer: the kernel runs for this frame's checkerboard colour only, then
+* ssao_checkerboard.frag passes those pixels through and rebuilds the others from their neighbours and the previous
+* frame. Reprojection covers camera motion; moving the scene invalidates the history like it does for temporal SSAO.
+*/
+void RenderCheckerboardSSAO()
+{
+	GLuint gBufferDepthSource = compactGBufferOn ? gDepth : gPosition;
+	unsigned int gBufferLayout = compactGBufferOn ? SSAO_COMPACT_GBUFFER : 0;
 
+	glViewport(0, 0, (renderWidth + 1) / 2, renderHeight);
+	glBindFramebuffer(GL_FRAMEBUFFER, checkerboardHalfFBO);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, gBufferDepthSource);
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, gNormal);
-
 	glActiveTexture(GL_TEXTURE2);
 	glBindTexture(GL_TEXTURE_2D, noiseTexture);
 
-	glBindVertexArray(QuadVAO);
-	RenderQuad(::SSAO_Program, ::QuadTransformation);
+	RenderQuad(GetAOProgram(gBufferLayout | SSAO_CHECKERBOARD));
+
+	glViewport(0, 0, renderWidth, renderHeight);
+
+	cyMatrix4f view = GetViewMatrix();
+	cyMatrix4f reprojection = checkerboardViewProjection * view.GetInverse();
+	unsigned int previous = checkerboardIndex;
+	unsigned int current = 1 - previous;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, checkerboardFBO[current]);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ssaoColorBuffer, 0);
+	cyGLSLProgram& CheckerboardProgram = SSAOCheckerboardVariants.Get(gBufferLayout);
+	CheckerboardProgram.Bind();
+	float matrix[16];
+	reprojection.Get(matrix);
+	CheckerboardProgram.SetUniformMatrix4("reprojection", matrix);
+	CheckerboardProgram.SetUniform("historyValid", checkerboardHistoryValid);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, gBufferDepthSource);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, checkerboardHalfOcclusion);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, checkerboardHistory[previous]);
+
+	RenderQuad(CheckerboardProgram);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+	checkerboardIndex = current;
+	checkerboardHistoryValid = true;
+	checkerboardViewProjection = GetProjectionMatrix() * view;
+}
+
+// The full resolution kernel pass as a compute shader writing ssaoColorBuffer through an image. Adaptive sampling only
+// exists in the fragment shader.
+void DispatchComputeSSAO()
+{
+	cyGLSLProgram& Program = SSAOComputeVariants.Get((compactGBufferOn ? SSAO_COMPACT_GBUFFER : 0) | (temporalSSAOOn ? SSAO_TEMPORAL : 0));
+	Program.Bind();
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, compactGBufferOn ? gDepth : gPosition);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, gNormal);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, noiseTexture);
+	glBindImageTexture(0, ssaoColorBuffer, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8);
+
+	glDispatchCompute((renderWidth + SSAO_TILE_SIZE - 1) / SSAO_TILE_SIZE, (renderHeight + SSAO_TILE_SIZE - 1) / SSAO_TILE_SIZE, 1);
+
+	// later passes sample ssaoColorBuffer or read it back through a framebuffer
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+	glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8);
+}
+
+// one pass of the bilateral blur into the bound framebuffer: 0 across, 1 down. Expects the gBuffer depth and normals
+// on units 0 and 1 and the occlusion to filter on unit 2.
+void RenderBlurPass(int pass)
+{
+	cyGLSLProgram& BlurProgram = BlurVariants.Get(compactGBufferOn ? SSAO_COMPACT_GBUFFER : 0);
+	BlurProgram.Bind();
+	BlurProgram.SetUniform("radius", ssaoBlurRadius);
+	BlurProgram.SetUniform("direction", 1 - pass, pass);
 
-	// Blur SSAO texture
-	glBindFramebuffer(GL_FRAMEBUFFER, ssaoBlurFBO);
 	glClear(GL_COLOR_BUFFER_BIT);
+	RenderQuad(BlurProgram);
+}
+
+// both blur passes outside the render graph, filtering occlusion into ssaoColorBufferBlur. Used by the benchmarks.
+void BlurSSAO(GLuint occlusion)
+{
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, compactGBufferOn ? gDepth : gPosition);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, gNormal);
+
+	GLuint inputs[2] = { occlusion, ssaoColorBufferBlurTemp };
+	GLuint outputs[2] = { ssaoBlurTempFBO, ssaoBlurFBO };
+	for (int pass = 0; pass < 2; pass++)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, outputs[pass]);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, inputs[pass]);
+		RenderBlurPass(pass);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+/*
+* Blends ssaoColorBuffer into the history of the previous frame. Every pixel is reprojected to where its surface was
+* last frame with the previous view-projection; the history is dropped where that lands off screen or on a different
+* depth. Only camera motion is reprojected, so moving the scene invalidates the whole history instead.
+*/
+void ResolveTemporalSSAO()
+{
+	cyMatrix4f view = GetViewMatrix();
+	cyMatrix4f reprojection = previousViewProjection * view.GetInverse();
+	unsigned int previous = ssaoHistoryIndex;
+	unsigned int current = 1 - previous;
+
+	if (!ssaoHistoryValid)
+	{
+		// zero frames and zero depth, rejected by every pixel
+		glBindFramebuffer(GL_FRAMEBUFFER, ssaoHistoryFBO[previous]);
+		glClear(GL_COLOR_BUFFER_BIT);
+		ssaoHistoryValid = true;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, ssaoHistoryFBO[current]);
+	cyGLSLProgram& TemporalProgram = SSAOTemporalVariants.Get(compactGBufferOn ? SSAO_COMPACT_GBUFFER : 0);
+	TemporalProgram.Bind();
+	float matrix[16];
+	reprojection.Get(matrix);
+	TemporalProgram.SetUniformMatrix4("reprojection", matrix);
 
 	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, compactGBufferOn ? gDepth : gPosition);
+	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, ssaoColorBuffer);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, ssaoHistory[previous]);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, ssaoHistoryDepth[previous]);
 
-	RenderQuad(::BlurProgram, ::QuadTransformation);
+	RenderQuad(TemporalProgram);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-	// Lighting pass
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	ssaoHistoryIndex = current;
+	previousViewProjection = GetProjectionMatrix() * view;
+}
 
+// the AO program of the selected technique for a gBuffer layout (SSAO_COMPACT_GBUFFER, SSAO_DOWNSAMPLED_GBUFFER,
+// SSAO_DEINTERLEAVED, SSAO_CHECKERBOARD), bound with the kernel radius and inner radius of this draw. The programs
+// are shared between the paths, so every draw sets both. Only asks for masks IsReachableSSAOVariant accepts.
+cyGLSLProgram& GetAOProgram(unsigned int layout, float radius, float innerRadius)
+{
+	if (aoTechnique == AO_HORIZON) return HorizonAOVariants.Get(layout);
 
-	LightingPassProgram.Bind();
-	LightingPassProgram.SetUniform("ambientOcclusionOn", ambientOcclusionOn);
-	LightingPassProgram.SetUniform("attenuationOn", attenuationOn);
-	LightingPassProgram.SetUniform3("light.Color", &lightColors[lightIndex][0]);
+	bool depthPyramid = depthPyramidOn && !(layout & SSAO_DEINTERLEAVED);	// the deinterleaved layers replace it
+	cyGLSLProgram& Program = SSAOVariants.Get(layout | (depthPyramid ? SSAO_DEPTH_PYRAMID : 0) |
+		(temporalSSAOOn ? SSAO_TEMPORAL : 0) | (adaptiveSSAOOn ? SSAO_ADAPTIVE : 0));
+	Program.Bind();
+	Program.SetUniform("radius", radius);
+	Program.SetUniform("innerRadius", innerRadius);
+	if (adaptiveSSAOOn) Program.SetUniform("recordSampleCounts", sampleHistogramRequested);
+	return Program;
+}
 
+/*
+* Prints how many pixels of this frame's SSAO pass took each number of samples. Reading the counters back waits for
+* the pass to finish, which is fine for a one-off request.
+*/
+void PrintSampleHistogram()
+{
+	if (!adaptiveSSAOOn || aoTechnique != AO_KERNEL)
+	{
+		printf("The sample histogram needs adaptive SSAO with the kernel technique\n");
+		return;
+	}
 
+	std::vector<GLuint> counts(NUM_SAMPLES / ADAPTIVE_BATCH);
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, sampleHistogramBuffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint) * counts.size(), &counts[0]);
+
+	unsigned long long pixels = 0, samples = 0;
+	for (size_t i = 0; i < counts.size(); i++)
+	{
+		pixels += counts[i];
+		samples += (unsigned long long)counts[i] * (i + 1) * ADAPTIVE_BATCH;
+	}
+	if (pixels == 0) return;
+
+	printf("SSAO samples per pixel: %.1f on average, %u without adaptive sampling\n", samples / (double)pixels, GetAOFetches());
+	for (size_t i = 0; i < counts.size(); i++)
+	{
+		if (counts[i] == 0) continue;
+		printf("  %2u samples: %9u pixels  %5.1f%%\n", (unsigned int)((i + 1) * ADAPTIVE_BATCH), counts[i], 100.0 * counts[i] / pixels);
+	}
+}
+
+// depth fetches per pixel of the selected technique in one frame, the most adaptive sampling takes
+unsigned int GetAOFetches()
+{
+	if (aoTechnique == AO_HORIZON) return HORIZON_SLICES * HORIZON_STEPS * 2;
+
+	unsigned int fetches = temporalSSAOOn ? TEMPORAL_SAMPLES : NUM_SAMPLES;
+	if (deinterleavedSSAOOn) return fetches;
+	if (!multiScaleAOOn && ssaoResolutionDivisor == 1 && checkerboardSSAOOn) return fetches / 2;
+	if (!multiScaleAOOn) return fetches;
+
+	// every coarser scale has a quarter of the pixels of the one before
+	unsigned int total = 0;
+	for (unsigned int scale = 0; scale < AO_SCALES; scale++) total += fetches >> (2 * scale);
+	return total;
+}
+
+/*
+* Renders the AO of the current frame AO_BENCHMARK_RUNS times with each technique at the current settings and prints
+* the average GPU time together with the RMSE against the brute force ray marched reference of ao_reference.frag at
+* full resolution. The reference is of the current view, so moving the camera or the scene benchmarks another pose.
+* At full resolution the kernel is timed both as the fragment and the compute shader. With temporal SSAO on, the
+* single frame numbers are followed by the converged result of accumulating AO_BENCHMARK_RUNS frames from an empty
+* history. Leaves the selected technique's result in ssaoColorBuffer.
+*/
+void RunAOBenchmark()
+{
+	AOTechnique selected = aoTechnique;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, ssaoFBO);
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gPosition);
+	glBindTexture(GL_TEXTURE_2D, compactGBufferOn ? gDepth : gPosition);
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, gNormal);
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, gAlbedo);
-	glActiveTexture(GL_TEXTURE3); // add extra SSAO texture to lighting pass
+	RenderQuad(AOReferenceVariants.Get(compactGBufferOn ? SSAO_COMPACT_GBUFFER : 0));
+	std::vector<float> reference = ReadOcclusion(ssaoFBO);
 
-	ssaoBlurOn ? glBindTexture(GL_TEXTURE_2D, ssaoColorBufferBlur) : glBindTexture(GL_TEXTURE_2D, ssaoColorBuffer);
+	printf("AO benchmark at %dx%d, %u runs each, reference: %u rays x %u steps\n",
+		renderWidth, renderHeight, AO_BENCHMARK_RUNS, REFERENCE_DIRECTIONS * REFERENCE_DIRECTIONS, REFERENCE_STEPS);
 
-	RenderQuad(::LightingPassProgram, ::QuadTransformation);
+	// the compute shader only replaces the full resolution kernel pass
+	bool selectedCompute = computeSSAOOn;
+	bool computeApplies = !deinterleavedSSAOOn && !multiScaleAOOn && !checkerboardSSAOOn && ssaoResolutionDivisor == 1;
 
-	glutSwapBuffers();
+	struct BenchmarkRow { const char* name; AOTechnique technique; bool compute; };
+	BenchmarkRow rows[3] = { { "kernel", AO_KERNEL, false }, { "compute", AO_KERNEL, true }, { "horizon", AO_HORIZON, false } };
+	for (const BenchmarkRow& row : rows)
+	{
+		if (row.compute && !computeApplies) continue;
+		aoTechnique = row.technique;
+		computeSSAOOn = row.compute;
+
+		aoTimer.Reset();
+		for (unsigned int run = 0; run < AO_BENCHMARK_RUNS; run++)
+		{
+			aoTimer.Begin();
+			RenderSSAO();
+			aoTimer.End();
+		}
+		double milliseconds = aoTimer.GetAverageMilliseconds();
+
+		printf("  %-8s %3u fetches/pixel  %7.3f ms  RMSE %.4f\n", row.name, GetAOFetches(), milliseconds,
+			GetRMSE(ReadOcclusion(ssaoFBO), reference));
+	}
+
+	aoTechnique = selected;
+	computeSSAOOn = selectedCompute;
+
+	if (temporalSSAOOn)
+	{
+		// a static camera, so every frame reprojects onto itself and only the kernel rotation changes
+		ssaoHistoryValid = false;
+		aoTimer.Reset();
+		for (unsigned int run = 0; run < AO_BENCHMARK_RUNS; run++)
+		{
+			ssaoFrameIndex++;
+			UpdateFrameUniforms();
+			aoTimer.Begin();
+			RenderSSAO();
+			ResolveTemporalSSAO();
+			aoTimer.End();
+		}
+		double milliseconds = aoTimer.GetAverageMilliseconds();
+
+		printf("  temporal %3u fetches/pixel  %7.3f ms  RMSE %.4f after %u frames\n", GetAOFetches(), milliseconds,
+			GetRMSE(ReadOcclusion(ssaoHistoryFBO[ssaoHistoryIndex]), reference), AO_BENCHMARK_RUNS);
+	}
+
+	RenderSSAO();
+}
+
+double GetRMSE(const std::vector<float>& values, const std::vector<float>& reference)
+{
+	double squaredError = 0.0;
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		squaredError += (values[i] - reference[i]) * (values[i] - reference[i]);
+	}
+	return sqrt(squaredError / values.size());
+}
+
+/*
+* Quality equivalence of the sampling patterns: every kernel pattern with white and blue noise rotations, with the full
+* kernel and with a single TEMPORAL_SAMPLES subset of it, each compared against the ray marched AO reference
+* straight out of the SSAO pass and after the blur. Every TEMPORAL_SAMPLES row passes or fails against the original
+* kernel at NUM_SAMPLES, see SAMPLING_EQUIVALENCE_TOLERANCE. Runs a single unaccumulated frame of the full
+* resolution fragment pass and restores every setting afterwards.
+*/
+void RunSamplingBenchmark()
+{
+	if (deinterleavedSSAOOn || multiScaleAOOn || ssaoResolutionDivisor > 1)
+	{
+		printf("The sampling benchmark runs on the full resolution SSAO path\n");
+		return;
+	}
+
+	KernelPattern selectedKernel = kernelPattern;
+	NoisePattern selectedNoise = noisePattern;
+	AOTechnique selectedTechnique = aoTechnique;
+	bool selectedTemporal = temporalSSAOOn, selectedAdaptive = adaptiveSSAOOn, selectedCompute = computeSSAOOn;
+	bool selectedCheckerboard = checkerboardSSAOOn;
+	unsigned int selectedFrame = ssaoFrameIndex;
+	aoTechnique = AO_KERNEL;
+	adaptiveSSAOOn = computeSSAOOn = checkerboardSSAOOn = false;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, ssaoFBO);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, compactGBufferOn ? gDepth : gPosition);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, gNormal);
+	RenderQuad(AOReferenceVariants.Get(compactGBufferOn ? SSAO_COMPACT_GBUFFER : 0));
+	std::vector<float> reference = ReadOcclusion(ssaoFBO);
+	BlurSSAO(ssaoColorBuffer);
+	std::vector<float> blurredReference = ReadOcclusion(ssaoBlurFBO);
+
+	printf("Sampling patterns at %dx%d against %u rays x %u steps (RMSE raw / blurred)\n",
+		renderWidth, renderHeight, REFERENCE_DIRECTIONS * REFERENCE_DIRECTIONS, REFERENCE_STEPS);
+
+	// frame 0 of the temporal subsets is sample 0, 4, 8, ... without extra rotation
+	ssaoFrameIndex = 0;
+	UpdateFrameUniforms();
+
+	// the first row, the random kernel with white noise at NUM_SAMPLES, is what the reduced rows have to match
+	double baseline = -1.0;
+	unsigned int reducedRows = 0, equivalentRows = 0;
+
+	NoisePattern noises[2] = { NOISE_WHITE, NOISE_BLUE };
+	for (NoisePattern noise : noises)
+	{
+		noisePattern = noise;
+		GenerateNoiseTexture();
+		for (unsigned int pattern = 0; pattern < KERNEL_PATTERN_COUNT; pattern++)
+		{
+			kernelPattern = (KernelPattern)pattern;
+			UploadSampleKernel();
+
+			unsigned int sampleCounts[2] = { NUM_SAMPLES, TEMPORAL_SAMPLES };
+			for (unsigned int samples : sampleCounts)
+			{
+				temporalSSAOOn = samples != NUM_SAMPLES;
+				RenderSSAO();
+				double error = GetRMSE(ReadOcclusion(ssaoFBO), reference);
+				BlurSSAO(ssaoColorBuffer);
+				double blurredError = GetRMSE(ReadOcclusion(ssaoBlurFBO), blurredReference);
+				if (baseline < 0.0) baseline = blurredError;
+
+				const char* verdict = "";
+				if (samples != NUM_SAMPLES)
+				{
+					bool equivalent = blurredError <= baseline * SAMPLING_EQUIVALENCE_TOLERANCE;
+					verdict = equivalent ? "  PASS" : "  FAIL";
+					reducedRows++;
+					equivalentRows += equivalent ? 1 : 0;
+				}
+				printf("  %-9s %s noise %2u samples  %.4f / %.4f%s\n", GetKernelPatternName(kernelPattern),
+					noise == NOISE_BLUE ? "blue " : "white", samples, error, blurredError, verdict);
+			}
+		}
+	}
+
+	printf("%u of %u patterns at %u samples match the original kernel at %u samples within %.0f%%\n", equivalentRows,
+		reducedRows, TEMPORAL_SAMPLES, NUM_SAMPLES, (SAMPLING_EQUIVALENCE_TOLERANCE - 1.0) * 100.0);
+
+	kernelPattern = selectedKernel;
+	noisePattern = selectedNoise;
+	aoTechnique = selectedTechnique;
+	temporalSSAOOn = selectedTemporal;
+	adaptiveSSAOOn = selectedAdaptive;
+	computeSSAOOn = selectedCompute;
+	checkerboardSSAOOn = selectedCheckerboard;
+	ssaoFrameIndex = selectedFrame;
+	UploadSampleKernel();
+	GenerateNoiseTexture();
+	UpdateFrameUniforms();
+	RenderSSAO();
+}
+
+// the red channel of the first color attachment of framebuffer
+std::vector<float> ReadOcclusion(GLuint framebuffer)
+{
+	std::vector<float> occlusion(renderWidth * renderHeight);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glReadPixels(0, 0, renderWidth, renderHeight, GL_RED, GL_FLOAT, &occlusion[0]);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	return occlusion;
+}
+
+/*
+* SSAO in three steps: split the depth into 16 quarter resolution layers, compute the occlusion of each layer with a
+* single noise rotation, then interleave the layers back into ssaoColorBuffer. Neighbouring pixels of a layer use the
+* same rotation, so their samples land close together and the depth fetches stay in cache.
+*/
+void RenderDeinterleavedSSAO()
+{
+	GLuint gBufferDepthSource = compactGBufferOn ? gDepth : gPosition;
+	glViewport(0, 0, (renderWidth + 3) / 4, (renderHeight + 3) / 4);
+
+	cyGLSLProgram& DeinterleaveProgram = SSAODeinterleaveVariants.Get(compactGBufferOn ? SSAO_COMPACT_GBUFFER : 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, gBufferDepthSource);
+	for (unsigned int half = 0; half < 2; half++)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, ssaoDeinterleaveFBO[half]);
+		DeinterleaveProgram.Bind();
+		DeinterleaveProgram.SetUniform("firstLayer", (int)(half * 8));
+		RenderQuad(DeinterleaveProgram);
+	}
+
+	cyGLSLProgram& SSAO_Program = GetAOProgram((compactGBufferOn ? SSAO_COMPACT_GBUFFER : 0) | SSAO_DEINTERLEAVED);
+	SSAO_Program.Bind();
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, gNormal);
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, ssaoDeinterleavedDepth);
+	for (unsigned int layer = 0; layer < SSAO_LAYERS; layer++)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, ssaoDeinterleavedFBO[layer]);
+		SSAO_Program.SetUniform("layer", (int)layer);
+		SSAO_Program.SetUniform("rotation", ssaoNoise[layer].x, ssaoNoise[layer].y, ssaoNoise[layer].z);
+		RenderQuad(SSAO_Program);
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);	// written again next frame
+
+	glViewport(0, 0, renderWidth, renderHeight);
+	glBindFramebuffer(GL_FRAMEBUFFER, ssaoFBO);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, ssaoDeinterleavedOcclusion);
+	RenderQuad(SSAOReinterleaveProgram);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-void RenderCube(cyGLSLProgram& Program, Transformation& Model)
+// Draws the cube and every model of the scene into the gBuffer. A depth only pass reads just the position stream.
+void RenderSceneGeometry(bool depthOnly)
 {
+	unsigned int layout = compactGBufferOn ? GEOMETRY_COMPACT_GBUFFER : 0;
+	cyGLSLProgram& CubeProgram = depthOnly ? DepthPrePassProgram : GeometryPassVariants.Get(GEOMETRY_INVERTED_NORMALS | layout);
+	cyGLSLProgram& Program = depthOnly ? DepthPrePassProgram : GeometryPassVariants.Get(GEOMETRY_READ_TEXTURE | layout);
+
+	glBindVertexArray(CubeVAO);
+	glEnable(GL_CULL_FACE);
+	glCullFace(GL_FRONT);
+	RenderCube(CubeProgram, CubeTransformIndex);
 	Program.Bind();
+	glCullFace(GL_BACK);
+
+	Model* culledModels[] = { TerrariumModel, AmeModel, StairModel, DoorModel };
+	Model* doubleSidedModels[] = { BackpackModel, TeapotModel };
 
-	float obj_mvp_buffer[16];
-	GetModelViewProjection(Model).Get(obj_mvp_buffer);
-	Program.SetUniformMatrix4("mvp", obj_mvp_buffer);
+	for (Model* model : culledModels)
+	{
+		BindObjectUniforms(model->transformIndex);
+		depthOnly ? model->DrawDepth(&dynamicBuffer) : model->Draw(Program, &dynamicBuffer);
+	}
 
-	float obj_mv_buffer[16];
-	GetModelViewTransformation(Model).Get(obj_mv_buffer);
-	Program.SetUniformMatrix4("mv", obj_mv_buffer);
+	glDisable(GL_CULL_FACE);
 
-	Program.SetUniform("invertedNormals", true);
+	for (Model* model : doubleSidedModels)
+	{
+		BindObjectUniforms(model->transformIndex);
+		depthOnly ? model->DrawDepth(&dynamicBuffer) : model->Draw(Program, &dynamicBuffer);
+	}
 
-	glDrawArrays(GL_TRIANGLES, 0, 36);
+	glBindVertexArray(0);
 }
 
-void RenderQuad(cyGLSLProgram& Program, Transformation& Model)
+void RenderCube(cyGLSLProgram& Program, unsigned int transformIndex)
 {
 	Program.Bind();
 
-	float obj_mvp_buffer[16];
-	GetModelViewProjection(Model).Get(obj_mvp_buffer);
-	Program.SetUniformMatrix4("mvp", obj_mvp_buffer);
+	BindObjectUniforms(transformIndex);
 
-	float obj_mv_buffer[16];
-	GetModelViewTransformation(Model).Get(obj_mv_buffer);
-	Program.SetUniformMatrix4("mv", obj_mv_buffer);
+	glDrawArrays(GL_TRIANGLES, 0, 36);
+}
 
-	Program.SetUniform("invertedNormals", false);
+// The quad is already in clip space, so the full screen passes need no transformation uniforms
+void RenderQuad(cyGLSLProgram& Program)
+{
+	Program.Bind();
 
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 }
@@ -680,6 +2327,161 @@ void KeyboardAction(unsigned char key, int x, int y) {
 	case 50:
 		lightIndex = 2;
 		break;
+	case 43: // +
+	case 61: // =
+		renderScale = std::min(renderScale + RENDER_SCALE_STEP, MAX_RENDER_SCALE);
+		ResizeRenderTargets();
+		break;
+	case 45: // -
+		renderScale = std::max(renderScale - RENDER_SCALE_STEP, MIN_RENDER_SCALE);
+		ResizeRenderTargets();
+		break;
+	case 71:
+	case 103: // g
+		compactGBufferOn = !compactGBufferOn;
+		DeleteGBuffer();
+		if (!InitGBuffer()) {
+			fprintf(stderr, "Error initializing gBuffer.");
+			exit(1);
+		}
+		break;
+	case 72:
+	case 104: // h
+		// full, half, quarter resolution SSAO
+		ssaoResolutionDivisor = ssaoResolutionDivisor == 4 ? 1 : ssaoResolutionDivisor * 2;
+		DeleteRenderBuffer();
+		if (!CreateRenderBuffer())
+		{
+			fprintf(stderr, "Error initializing SSAO frame buffer object");
+			exit(1);
+		}
+		break;
+	case 66:
+	case 98: // b
+		aoBenchmarkRequested = true;
+		break;
+	case 79:
+	case 111: // o
+		aoTechnique = aoTechnique == AO_KERNEL ? AO_HORIZON : AO_KERNEL;
+		break;
+	case 75:
+	case 107: // k
+		kernelPattern = (KernelPattern)((kernelPattern + 1) % KERNEL_PATTERN_COUNT);
+		UploadSampleKernel();
+		printf("%s SSAO kernel\n", GetKernelPatternName(kernelPattern));
+		break;
+	case 74:
+	case 106: // j
+		noisePattern = noisePattern == NOISE_WHITE ? NOISE_BLUE : NOISE_WHITE;
+		GenerateNoiseTexture();
+		break;
+	case 86:
+	case 118: // v
+		samplingBenchmarkRequested = true;
+		break;
+	case 67:
+	case 99: // c
+		computeSSAOOn = !computeSSAOOn;
+		break;
+	case 65:
+	case 97: // a
+		adaptiveSSAOOn = !adaptiveSSAOOn;
+		break;
+	case 85:
+	case 117: // u
+		multiScaleAOOn = !multiScaleAOOn;
+		DeleteRenderBuffer();
+		if (!CreateRenderBuffer())
+		{
+			fprintf(stderr, "Error initializing SSAO frame buffer object");
+			exit(1);
+		}
+		break;
+	case 69:
+	case 101: // e
+		coverageMaskOn = !coverageMaskOn;
+		DeleteCoverageStencil();
+		if (!CreateCoverageStencil())
+		{
+			fprintf(stderr, "Error initializing coverage stencil frame buffer object");
+			exit(1);
+		}
+		break;
+	case 88:
+	case 120: // x
+		checkerboardSSAOOn = !checkerboardSSAOOn;
+		DeleteRenderBuffer();
+		if (!CreateRenderBuffer())
+		{
+			fprintf(stderr, "Error initializing SSAO frame buffer object");
+			exit(1);
+		}
+		break;
+	case 44: // ,
+		ssaoBlurRadius = std::max(ssaoBlurRadius - 1, 1);
+		printf("SSAO blur radius %d\n", ssaoBlurRadius);
+		break;
+	case 46: // .
+		ssaoBlurRadius = std::min(ssaoBlurRadius + 1, MAX_BLUR_RADIUS);
+		printf("SSAO blur radius %d\n", ssaoBlurRadius);
+		break;
+	case 70:
+	case 102: // f
+		fusedBlurOn = !fusedBlurOn;
+		break;
+	case 82:
+	case 114: // r
+		passCachingOn = !passCachingOn;
+		printf("Pass caching %s\n", passCachingOn ? "on" : "off");
+		break;
+	case 78:
+	case 110: // n
+		sampleHistogramRequested = true;
+		break;
+	case 89:
+	case 121: // y
+		renderGraphStatsRequested = true;
+		break;
+	case 84:
+	case 116: // t
+		temporalSSAOOn = !temporalSSAOOn;
+		DeleteRenderBuffer();
+		if (!CreateRenderBuffer())
+		{
+			fprintf(stderr, "Error initializing SSAO frame buffer object");
+			exit(1);
+		}
+		break;
+	case 73:
+	case 105: // i
+		deinterleavedSSAOOn = !deinterleavedSSAOOn;
+		DeleteRenderBuffer();
+		if (!CreateRenderBuffer())
+		{
+			fprintf(stderr, "Error initializing SSAO frame buffer object");
+			exit(1);
+		}
+		break;
+	case 76:
+	case 108: // l
+		manyLightsOn = !manyLightsOn;
+		break;
+	case 91: // [
+		pointLightCount = std::max(pointLightCount / 2, 1u);
+		printf("%u point lights\n", pointLightCount);
+		break;
+	case 93: // ]
+		pointLightCount = std::min(pointLightCount * 2, MAX_POINT_LIGHTS);
+		printf("%u point lights\n", pointLightCount);
+		break;
+	case 77:
+	case 109: // m
+		depthPyramidOn = !depthPyramidOn;
+		break;
+	case 80:
+	case 112: // p
+		depthPrePassOn = !depthPrePassOn;
+		break;
 	case 87:
 	case 119:
 		cameraZ -= 0.05f;
@@ -702,6 +2504,7 @@ void SpecialInput(int key, int x, int y)
 		ssaoBlurOn = !ssaoBlurOn;
 		break;
 	case GLUT_KEY_UP:
+		ssaoHistoryValid = checkerboardHistoryValid = false;	// the scene moves without motion vectors, nothing to reproject with
 		for (Model* m : scene)
 		{
 			if (m->invertZ)
@@ -712,6 +2515,7 @@ void SpecialInput(int key, int x, int y)
 		CubeTransformation.IncrementTranslation(0.0f, -sceneDisplacement, 0.0f);
 		break;
 	case GLUT_KEY_DOWN:
+		ssaoHistoryValid = checkerboardHistoryValid = false;
 		for (Model* m : scene)
 		{
 			if (m->invertZ)
@@ -737,39 +2541,150 @@ float GetRelativeDisplacement(Transformation ob1, Transformation ob2, float disp
 	return (displacementAmount / ob2.GetUniformScale()) * ob1.GetUniformScale();
 }
 
-cyMatrix4f GetModelViewProjection(Transformation t)
+cyMatrix4f GetViewMatrix()
 {
-	cy::Matrix4f model_matrix = cy::Matrix4f::Scale(t.scale)
-		* cy::Matrix4f::RotationXYZ(t.rotation.x, t.rotation.y, t.rotation.z)
-		* cy::Matrix4f::Translation(t.translation);
-
-	cy::Matrix4f view_matrix = cy::Matrix4f::View(
+	return cy::Matrix4f::View(
 		cyVec3f(0.0f, 0.0f, cameraZ),
 		cyVec3f(0.0f, 0.0f, 0.0f),
 		cyVec3f(0.0f, 1.0f, 0.0f)
 	);
+}
 
-	cy::Matrix4f projection_matrix = cy::Matrix4f::Perspective(
-		DEG2RAD(t.perspective_degrees),
-		(float)WINDOW_WIDTH / (float)WINDOW_HEIGHT,
+cyMatrix4f GetProjectionMatrix()
+{
+	return cy::Matrix4f::Perspective(
+		DEG2RAD(CubeTransformation.perspective_degrees),
+		(float)windowWidth / (float)windowHeight,
 		0.1f, 1000.0f);
+}
 
-	return projection_matrix * view_matrix * model_matrix;
+void UpdateFrameUniforms()
+{
+	cyMatrix4f view = GetViewMatrix();
+	cyMatrix4f projection = GetProjectionMatrix();
+
+	FrameUniforms frame;
+	view.Get(frame.view);
+	projection.Get(frame.projection);
+	(projection * view).Get(frame.viewProjection);
+	projection.GetInverse().Get(frame.inverseProjection);
+	frame.cameraPosition[0] = 0.0f;
+	frame.cameraPosition[1] = 0.0f;
+	frame.cameraPosition[2] = cameraZ;
+	frame.cameraPosition[3] = 1.0f;
+	frame.screenSize[0] = (float)renderWidth;
+	frame.screenSize[1] = (float)renderHeight;
+	frame.screenSize[2] = 1.0f / renderWidth;
+	frame.screenSize[3] = 1.0f / renderHeight;
+
+	// golden angle steps spread the rotations of consecutive frames evenly, the kernel subsets repeat every stride frames
+	unsigned int kernelStride = NUM_SAMPLES / TEMPORAL_SAMPLES;
+	frame.temporalJitter[0] = (float)fmod(ssaoFrameIndex * 2.399963, 2.0 * PI);
+	frame.temporalJitter[1] = (float)(ssaoFrameIndex % kernelStride);
+	frame.temporalJitter[2] = (float)kernelStride;
+	frame.temporalJitter[3] = (float)(ssaoFrameIndex & 1);
+
+	RingBuffer::Allocation allocation = dynamicBuffer.AllocateUniforms(sizeof(frame));
+	memcpy(allocation.data, &frame, sizeof(frame));
+	dynamicBuffer.BindRange(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, allocation.offset, sizeof(frame));
 }
 
-cyMatrix4f GetModelViewTransformation(Transformation t)
+// Copies the matrices computed by TransformSystem::Update into this frame's per-object uniform slots
+void UpdateObjectUniforms()
 {
-	cy::Matrix4f model_matrix = cy::Matrix4f::Scale(t.scale)
-		* cy::Matrix4f::RotationXYZ(t.rotation.x, t.rotation.y, t.rotation.z)
-		* cy::Matrix4f::Translation(t.translation);
+	RingBuffer::Allocation allocation = dynamicBuffer.AllocateUniforms(objectUniformStride * transforms.Count());
+	objectUniformOffset = allocation.offset;
 
-	cy::Matrix4f view_matrix = cy::Matrix4f::View(
-		cyVec3f(0.0, 0.0f, cameraZ),
-		cyVec3f(0.0, 0.0, 0.0),
-		cyVec3f(0.0, 1.0, 0.0)
-	);
+	for (unsigned int i = 0; i < transforms.Count(); i++)
+	{
+		ObjectUniforms* object = (ObjectUniforms*)((unsigned char*)allocation.data + i * objectUniformStride);
+		memcpy(object->model, transforms.GetModel(i), sizeof(object->model));
+		memcpy(object->modelView, transforms.GetModelView(i), sizeof(object->modelView));
+		memcpy(object->modelViewProjection, transforms.GetModelViewProjection(i), sizeof(object->modelViewProjection));
+		memcpy(object->normalMatrix, transforms.GetNormalMatrix(i), sizeof(object->normalMatrix));
+	}
+}
+
+void UpdateLightUniforms()
+{
+	LightUniforms light = {
+		{ 2.0f, 4.0f, 6.0f, 1.0f },
+		{ lightColors[lightIndex].x, lightColors[lightIndex].y, lightColors[lightIndex].z, 1.0f }
+	};
+
+	RingBuffer::Allocation allocation = dynamicBuffer.AllocateUniforms(sizeof(light));
+	memcpy(allocation.data, &light, sizeof(light));
+	dynamicBuffer.BindRange(GL_UNIFORM_BUFFER, LIGHT_UNIFORM_BINDING, allocation.offset, sizeof(light));
+}
+
+// Random colored lights inside the cube. They live in its model space so they follow the scene when it is moved.
+void GeneratePointLights()
+{
+	std::uniform_real_distribution<GLfloat> randomFloats(0.0, 1.0);
+	std::default_random_engine generator;
 
-	return view_matrix * model_matrix;
+	pointLights.resize(MAX_POINT_LIGHTS);
+	for (PointLight& light : pointLights)
+	{
+		light.position[0] = randomFloats(generator) * 1.8f - 0.9f;
+		light.position[1] = randomFloats(generator) * 1.8f - 0.9f;
+		light.position[2] = randomFloats(generator) * 1.8f - 0.9f;
+		light.position[3] = 0.1f + randomFloats(generator) * 0.2f;
+
+		// saturated colors: the brightest channel is always 1
+		float r = randomFloats(generator), g = randomFloats(generator), b = randomFloats(generator);
+		float brightest = std::max(std::max(r, g), std::max(b, 0.001f));
+		light.color[0] = r / brightest;
+		light.color[1] = g / brightest;
+		light.color[2] = b / brightest;
+		light.color[3] = 1.0f;
+	}
+}
+
+// Moves the active point lights to view space, bins them into clusters and uploads the light list, the clusters and
+// the light indices into this frame's segment of the dynamic buffer
+void UpdatePointLights()
+{
+	const float* modelView = transforms.GetModelView(CubeTransformIndex);
+	float scale = CubeTransformation.GetUniformScale();
+
+	std::vector<PointLight> viewLights(pointLights.begin(), pointLights.begin() + pointLightCount);
+	for (PointLight& light : viewLights)
+	{
+		float x = light.position[0], y = light.position[1], z = light.position[2];
+		for (int row = 0; row < 3; row++)
+			light.position[row] = modelView[row] * x + modelView[4 + row] * y + modelView[8 + row] * z + modelView[12 + row];
+		light.position[3] *= scale;
+	}
+
+	lightClusters.Build(viewLights, GetProjectionMatrix(), 0.1f, CLUSTER_FAR_DEPTH);
+
+	GLsizeiptr lightsSize = sizeof(PointLight) * viewLights.size();
+	RingBuffer::Allocation lights = dynamicBuffer.AllocateStorage(lightsSize);
+	memcpy(lights.data, &viewLights[0], lightsSize);
+	dynamicBuffer.BindRange(GL_SHADER_STORAGE_BUFFER, LIGHT_STORAGE_BINDING, lights.offset, lightsSize);
+
+	const std::vector<unsigned int>& clusterList = lightClusters.GetClusters();
+	GLsizeiptr clustersSize = sizeof(unsigned int) * clusterList.size();
+	RingBuffer::Allocation clusters = dynamicBuffer.AllocateStorage(clustersSize);
+	memcpy(clusters.data, &clusterList[0], clustersSize);
+	dynamicBuffer.BindRange(GL_SHADER_STORAGE_BUFFER, CLUSTER_STORAGE_BINDING, clusters.offset, clustersSize);
+
+	const std::vector<unsigned int>& indexList = lightClusters.GetLightIndices();
+	GLsizeiptr indicesSize = sizeof(unsigned int) * indexList.size();
+	RingBuffer::Allocation indices = dynamicBuffer.AllocateStorage(indicesSize);
+	memcpy(indices.data, &indexList[0], indicesSize);
+	dynamicBuffer.BindRange(GL_SHADER_STORAGE_BUFFER, LIGHT_INDEX_STORAGE_BINDING, indices.offset, indicesSize);
+
+	ClusterUniforms clusterUniforms = lightClusters.GetUniforms();
+	RingBuffer::Allocation uniforms = dynamicBuffer.AllocateUniforms(sizeof(clusterUniforms));
+	memcpy(uniforms.data, &clusterUniforms, sizeof(clusterUniforms));
+	dynamicBuffer.BindRange(GL_UNIFORM_BUFFER, CLUSTER_UNIFORM_BINDING, uniforms.offset, sizeof(clusterUniforms));
+}
+
+void BindObjectUniforms(unsigned int transformIndex)
+{
+	dynamicBuffer.BindRange(GL_UNIFORM_BUFFER, OBJECT_UNIFORM_BINDING, objectUniformOffset + transformIndex * objectUniformStride, sizeof(ObjectUniforms));
 }
 
 
@@ -784,56 +2699,31 @@ void MouseAction(int button, int state, int x, int y) {
 }
 
 void MouseMove(int x, int y) {
-
+	ssaoHistoryValid = checkerboardHistoryValid = false;	// the scene rotates without motion vectors, nothing to reproject with
 
 	for (Model* m : scene)
 	{
 		if (m->invertY)
-			m->transformation.IncrementRotation(-(client.y - y) / WINDOW_HEIGHT * 5, (client.x - x) / WINDOW_WIDTH * 5, 0.0);
+			m->transformation.IncrementRotation(-(client.y - y) / windowHeight * 5, (client.x - x) / windowWidth * 5, 0.0);
 		else
-			m->transformation.IncrementRotation((client.y - y) / WINDOW_HEIGHT * 5, (client.x - x) / WINDOW_WIDTH * 5, 0.0);
+			m->transformation.IncrementRotation((client.y - y) / windowHeight * 5, (client.x - x) / windowWidth * 5, 0.0);
 	}
-	::CubeTransformation.IncrementRotation((client.y - y) / WINDOW_HEIGHT * 5, (client.x - x) / WINDOW_WIDTH * 5, 0.0);
+	::CubeTransformation.IncrementRotation((client.y - y) / windowHeight * 5, (client.x - x) / windowWidth * 5, 0.0);
 	client.x = x;
 	client.y = y;
 
 }
 
-void Idle()
+void Reshape(int width, int height)
 {
-	glutPostRedisplay();
-}
+	if (width <= 0 || height <= 0) return;	// minimized
 
-float lerp(float a, float b, float f)
-{
-	return a + f * (b - a);
+	windowWidth = width;
+	windowHeight = height;
+	ResizeRenderTargets();
 }
 
-std::vector<cyVec3f> GenerateSampleKernel(unsigned int num_samples)
+void Idle()
 {
-	std::uniform_real_distribution<GLfloat> randomFloats(0.0, 1.0);
-	std::default_random_engine generator;
-
-	std::vector<cyVec3f> kernel;
-	for (unsigned int i = 0; i < num_samples; i++)
-	{
-		// generate random samples
-		cyVec3f sample(
-			randomFloats(generator) * 2.0 - 1.0,
-			randomFloats(generator) * 2.0 - 1.0,
-			randomFloats(generator)
-		);
-
-		sample.Normalize();
-		sample *= randomFloats(generator);
-
-		// adjust samples to keep them near the origin.
-		float scale = float(i) / num_samples;
-		scale = lerp(0.1f, 1.0f, scale * scale);
-		sample *= scale;
-
-		kernel.push_back(sample);
-	}
-
-	return kernel;
-}
\ No newline at end of file
+	glutPostRedisplay();
+}
@@ -0,0 +1,250 @@
+#ifndef TRANSFORM_SYSTEM_H
+#define TRANSFORM_SYSTEM_H
+
+#include <xmmintrin.h>
+#include <cyMatrix.h>
+#include "Transformation.h"
+#include <cstring>
+#include <vector>
+using namespace std;
+
+/*
+* Owns the per-object transform data of the scene in structure-of-arrays form and computes the model, model-view and
+* model-view-projection matrices of every registered object once per frame.
+*
+* Objects are processed in groups of four, one object per SSE lane. A group is only recomputed when one of its objects
+* reported a change through Transformation::dirty or when the view or projection matrix changed since the last update.
+* Results are stored as column-major float[16] per object so they can be handed to glUniformMatrix4fv directly. The
+* normal matrix (inverse transpose of the model-view's upper 3x3) is stored as three vec4 columns, matching the std140
+* layout of a mat3 inside a uniform block.
+*/
+class TransformSystem
+{
+public:
+	static const unsigned int LANES = 4;
+
+	// registers a transformation and returns the index used to read its matrices back
+	unsigned int Add(Transformation* t)
+	{
+		unsigned int index = (unsigned int)sources.size();
+		sources.push_back(t);
+		t->dirty = true;
+
+		// grow the lanes in whole groups so a batch never reads past the end of the arrays
+		size_t padded = ((sources.size() + LANES - 1) / LANES) * LANES;
+		for (unsigned int c = 0; c < COMPONENT_COUNT; c++) components[c].resize(padded, 0.0f);
+		model.resize(padded * 16, 0.0f);
+		modelView.resize(padded * 16, 0.0f);
+		modelViewProjection.resize(padded * 16, 0.0f);
+		normalMatrix.resize(padded * 12, 0.0f);
+		groupDirty.resize(padded / LANES, true);
+
+		return index;
+	}
+
+	// pulls changed transformations into the lanes and recomputes the matrices of every group that changed.
+	// Returns true when any matrix was rewritten.
+	bool Update(const cyMatrix4f& view, const cyMatrix4f& projection)
+	{
+		bool cameraChanged = std::memcmp(view.cell, lastView.cell, sizeof(lastView.cell)) != 0
+			|| std::memcmp(projection.cell, lastProjection.cell, sizeof(lastProjection.cell)) != 0;
+		if (cameraChanged)
+		{
+			lastView = view;
+			lastProjection = projection;
+			viewProjection = projection * view;
+		}
+
+		for (unsigned int i = 0; i < sources.size(); i++)
+		{
+			if (!sources[i]->dirty) continue;
+			Gather(i, *sources[i]);
+			sources[i]->dirty = false;
+			groupDirty[i / LANES] = true;
+		}
+
+		bool updated = false;
+		for (unsigned int g = 0; g < groupDirty.size(); g++)
+		{
+			if (!groupDirty[g] && !cameraChanged) continue;
+			ComputeGroup(g * LANES);
+			groupDirty[g] = false;
+			updated = true;
+		}
+		return updated;
+	}
+
+	const float* GetModel(unsigned int index) const { return &model[index * 16]; }
+	const float* GetModelView(unsigned int index) const { return &modelView[index * 16]; }
+	const float* GetModelViewProjection(unsigned int index) const { return &modelViewProjection[index * 16]; }
+	const float* GetNormalMatrix(unsigned int index) const { return &normalMatrix[index * 12]; }
+	unsigned int Count() const { return (unsigned int)sources.size(); }
+
+private:
+	// one array per scalar component, indexed by object
+	enum Component
+	{
+		SCALE_X, SCALE_Y, SCALE_Z,
+		TRANSLATE_X, TRANSLATE_Y, TRANSLATE_Z,
+		ROT_00, ROT_01, ROT_02,		// rotation column 0
+		ROT_10, ROT_11, ROT_12,		// rotation column 1
+		ROT_20, ROT_21, ROT_22,		// rotation column 2
+		COMPONENT_COUNT
+	};
+
+	vector<Transformation*> sources;
+	vector<float> components[COMPONENT_COUNT];
+	vector<bool> groupDirty;
+
+	vector<float> model;
+	vector<float> modelView;
+	vector<float> modelViewProjection;
+	vector<float> normalMatrix;
+
+	cyMatrix4f lastView = ZeroMatrix();
+	cyMatrix4f lastProjection = ZeroMatrix();
+	cyMatrix4f viewProjection = ZeroMatrix();
+
+	static cyMatrix4f ZeroMatrix()
+	{
+		cyMatrix4f m;
+		std::memset(m.cell, 0, sizeof(m.cell));
+		return m;
+	}
+
+	// the rotation stays scalar since it needs sin/cos, but it is only rebuilt for objects that changed
+	void Gather(unsigned int i, const Transformation& t)
+	{
+		cyMatrix4f rotation = cyMatrix4f::RotationXYZ(t.rotation.x, t.rotation.y, t.rotation.z);
+
+		components[SCALE_X][i] = t.scale.x;
+		components[SCALE_Y][i] = t.scale.y;
+		components[SCALE_Z][i] = t.scale.z;
+		components[TRANSLATE_X][i] = t.translation.x;
+		components[TRANSLATE_Y][i] = t.translation.y;
+		components[TRANSLATE_Z][i] = t.translation.z;
+		for (unsigned int c = 0; c < 3; c++)
+			for (unsigned int r = 0; r < 3; r++)
+				components[ROT_00 + c * 3 + r][i] = rotation.cell[c * 4 + r];
+	}
+
+	// out = a * m for four objects at once, where a is shared by all lanes and m is affine (bottom row 0 0 0 1)
+	static void MultiplyAffine(const cyMatrix4f& a, const __m128 m[16], __m128 out[16])
+	{
+		for (unsigned int c = 0; c < 4; c++)
+		{
+			for (unsigned int r = 0; r < 4; r++)
+			{
+				__m128 sum = _mm_add_ps(
+					_mm_add_ps(
+						_mm_mul_ps(_mm_set1_ps(a.cell[0 * 4 + r]), m[c * 4 + 0]),
+						_mm_mul_ps(_mm_set1_ps(a.cell[1 * 4 + r]), m[c * 4 + 1])),
+					_mm_mul_ps(_mm_set1_ps(a.cell[2 * 4 + r]), m[c * 4 + 2]));
+				if (c == 3) sum = _mm_add_ps(sum, _mm_set1_ps(a.cell[3 * 4 + r]));
+				out[c * 4 + r] = sum;
+			}
+		}
+	}
+
+	// transposes the sixteen lane registers back into one column-major matrix per object
+	static void Scatter(const __m128 m[16], float* out)
+	{
+		for (unsigned int e = 0; e < 16; e += 4)
+		{
+			__m128 r0 = m[e + 0], r1 = m[e + 1], r2 = m[e + 2], r3 = m[e + 3];
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(out + 0 * 16 + e, r0);
+			_mm_storeu_ps(out + 1 * 16 + e, r1);
+			_mm_storeu_ps(out + 2 * 16 + e, r2);
+			_mm_storeu_ps(out + 3 * 16 + e, r3);
+		}
+	}
+
+	// Scale * RotationXYZ * Translation, then view and projection, for objects [first, first + LANES)
+	void ComputeGroup(unsigned int first)
+	{
+		__m128 lane[COMPONENT_COUNT];
+		for (unsigned int c = 0; c < COMPONENT_COUNT; c++) lane[c] = _mm_loadu_ps(&components[c][first]);
+
+		__m128 scale[3] = { lane[SCALE_X], lane[SCALE_Y], lane[SCALE_Z] };
+		__m128 zero = _mm_setzero_ps();
+
+		__m128 m[16];
+		for (unsigned int c = 0; c < 3; c++)
+		{
+			for (unsigned int r = 0; r < 3; r++) m[c * 4 + r] = _mm_mul_ps(scale[r], lane[ROT_00 + c * 3 + r]);
+			m[c * 4 + 3] = zero;
+		}
+		for (unsigned int r = 0; r < 3; r++)
+		{
+			// translation is applied first, so it is rotated and scaled along with the vertex
+			__m128 rotated = _mm_add_ps(
+				_mm_add_ps(
+					_mm_mul_ps(lane[ROT_00 + r], lane[TRANSLATE_X]),
+					_mm_mul_ps(lane[ROT_10 + r], lane[TRANSLATE_Y])),
+				_mm_mul_ps(lane[ROT_20 + r], lane[TRANSLATE_Z]));
+			m[12 + r] = _mm_mul_ps(scale[r], rotated);
+		}
+		m[15] = _mm_set1_ps(1.0f);
+
+		__m128 mv[16], mvp[16];
+		MultiplyAffine(lastView, m, mv);
+		MultiplyAffine(viewProjection, m, mvp);
+
+		__m128 normal[12];
+		InverseTranspose3(mv, normal);
+
+		Scatter(m, &model[first * 16]);
+		Scatter(mv, &modelView[first * 16]);
+		Scatter(mvp, &modelViewProjection[first * 16]);
+		ScatterColumns3(normal, &normalMatrix[first * 12]);
+	}
+
+	static void Cross(const __m128 a[3], const __m128 b[3], __m128 out[3])
+	{
+		out[0] = _mm_sub_ps(_mm_mul_ps(a[1], b[2]), _mm_mul_ps(a[2], b[1]));
+		out[1] = _mm_sub_ps(_mm_mul_ps(a[2], b[0]), _mm_mul_ps(a[0], b[2]));
+		out[2] = _mm_sub_ps(_mm_mul_ps(a[0], b[1]), _mm_mul_ps(a[1], b[0]));
+	}
+
+	// inverse transpose of the upper 3x3 of m: its columns are the pairwise cross products of m's columns over det(m)
+	static void InverseTranspose3(const __m128 m[16], __m128 out[12])
+	{
+		__m128 c0[3] = { m[0], m[1], m[2] };
+		__m128 c1[3] = { m[4], m[5], m[6] };
+		__m128 c2[3] = { m[8], m[9], m[10] };
+
+		__m128 x12[3], x20[3], x01[3];
+		Cross(c1, c2, x12);
+		Cross(c2, c0, x20);
+		Cross(c0, c1, x01);
+
+		__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0[0], x12[0]), _mm_mul_ps(c0[1], x12[1])), _mm_mul_ps(c0[2], x12[2]));
+		// padding lanes are all zero, keep them finite
+		__m128 valid = _mm_cmpneq_ps(det, _mm_setzero_ps());
+		__m128 invDet = _mm_and_ps(valid, _mm_div_ps(_mm_set1_ps(1.0f), _mm_or_ps(det, _mm_andnot_ps(valid, _mm_set1_ps(1.0f)))));
+
+		for (unsigned int r = 0; r < 3; r++)
+		{
+			out[0 + r] = _mm_mul_ps(x12[r], invDet);
+			out[4 + r] = _mm_mul_ps(x20[r], invDet);
+			out[8 + r] = _mm_mul_ps(x01[r], invDet);
+		}
+		out[3] = out[7] = out[11] = _mm_setzero_ps();
+	}
+
+	// same as Scatter for three std140 mat3 columns (twelve floats) per object
+	static void ScatterColumns3(const __m128 m[12], float* out)
+	{
+		for (unsigned int e = 0; e < 12; e += 4)
+		{
+			__m128 r0 = m[e + 0], r1 = m[e + 1], r2 = m[e + 2], r3 = m[e + 3];
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(out + 0 * 12 + e, r0);
+			_mm_storeu_ps(out + 1 * 12 + e, r1);
+			_mm_storeu_ps(out + 2 * 12 + e, r2);
+			_mm_storeu_ps(out + 3 * 12 + e, r3);
+		}
+	}
+};
+#endif
@@ -8,6 +8,7 @@ public:
 	cyVec3f translation;
 	cyVec3f scale;
 	float perspective_degrees = 45.0f;
+	bool dirty = true;	// set by every mutator, cleared once TransformSystem has picked up the change
 
 	Transformation() : rotation(cyVec3f(0.0, 0.0, 0.0)), translation(cyVec3f(0.0, 0.0, 0.0)), scale(cyVec3f(1.0, 1.0, 1.0)) {}
 	Transformation(cyVec3f rotation, cyVec3f translation, cyVec3f scale) : rotation(rotation), translation(translation), scale(scale) {}
@@ -15,10 +16,10 @@ public:
 
 	~Transformation() {}
 
-	void IncrementRotation(float x, float y, float z) { rotation.Set(rotation.x + x, rotation.y + y, rotation.z + z); }
-	void IncrementTranslation(float x, float y, float z) { translation.Set(translation.x + x, translation.y + y, translation.z + z); }
-	void SetScale(cyVec3f new_scale) { scale = new_scale; }
-	void SetScale(float new_scale) { scale = cyVec3f(new_scale, new_scale, new_scale); }
+	void IncrementRotation(float x, float y, float z) { rotation.Set(rotation.x + x, rotation.y + y, rotation.z + z); dirty = true; }
+	void IncrementTranslation(float x, float y, float z) { translation.Set(translation.x + x, translation.y + y, translation.z + z); dirty = true; }
+	void SetScale(cyVec3f new_scale) { scale = new_scale; dirty = true; }
+	void SetScale(float new_scale) { scale = cyVec3f(new_scale, new_scale, new_scale); dirty = true; }
 	float GetUniformScale() { return scale.x; }
 };
 
@@ -0,0 +1,88 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <GL/glew.h>
+#include <cyGL.h>
+
+// binding points shared by the C++ side and the uniform blocks declared in the shaders
+enum UniformBinding
+{
+	FRAME_UNIFORM_BINDING = 0,
+	OBJECT_UNIFORM_BINDING = 1,
+	LIGHT_UNIFORM_BINDING = 2,
+	CLUSTER_UNIFORM_BINDING = 3,
+};
+
+// binding points of the shader storage blocks, a separate namespace from the uniform block bindings
+enum StorageBinding
+{
+	LIGHT_STORAGE_BINDING = 0,
+	CLUSTER_STORAGE_BINDING = 1,
+	LIGHT_INDEX_STORAGE_BINDING = 2,
+	SAMPLE_HISTOGRAM_STORAGE_BINDING = 3,
+};
+
+// std140 mirror of the FrameData block. Written once per frame.
+struct FrameUniforms
+{
+	float view[16];
+	float projection[16];
+	float viewProjection[16];
+	float inverseProjection[16];	// reconstructs view space position from depth with the compact gBuffer
+	float cameraPosition[4];
+	float screenSize[4];	// xy: render target size in pixels, zw: 1 / size
+	float temporalJitter[4];	// x: rotation of the SSAO noise this frame, y: first kernel sample, z: kernel stride,
+								// w: checkerboard colour rendered this frame
+};
+
+// std140 mirror of the ObjectData block. One entry per registered transformation.
+struct ObjectUniforms
+{
+	float model[16];
+	float modelView[16];
+	float modelViewProjection[16];
+	float normalMatrix[12];	// mat3 is stored as three vec4 columns in std140
+};
+
+// std140 mirror of the LightData block read by the lighting pass
+struct LightUniforms
+{
+	float position[4];	// view space
+	float color[4];
+};
+
+// std430 mirror of one entry of the LightList storage block
+struct PointLight
+{
+	float position[4];	// view space xyz, w: radius beyond which the light contributes nothing
+	float color[4];
+};
+
+// std140 mirror of the ClusterData block describing how the view frustum is split into light clusters
+struct ClusterUniforms
+{
+	unsigned int grid[4];	// xyz: tiles across, tiles up, depth slices, w: number of lights
+	float depth[4];	// x: near depth of the first slice, y: slices / log(far / near), z: far depth of the last slice
+};
+
+// connects a named uniform block of the program to one of the binding points above. Programs that don't declare the
+// block are left untouched.
+inline void BindUniformBlock(cyGLSLProgram& Program, const char* blockName, GLuint binding)
+{
+	GLuint blockIndex = glGetUniformBlockIndex(Program.GetID(), blockName);
+	if (blockIndex != GL_INVALID_INDEX) glUniformBlockBinding(Program.GetID(), blockIndex, binding);
+}
+
+// same as BindUniformBlock for a shader storage block
+inline void BindStorageBlock(cyGLSLProgram& Program, const char* blockName, GLuint binding)
+{
+	GLuint blockIndex = glGetProgramResourceIndex(Program.GetID(), GL_SHADER_STORAGE_BLOCK, blockName);
+	if (blockIndex != GL_INVALID_INDEX) glShaderStorageBlockBinding(Program.GetID(), blockIndex, binding);
+}
+
+// rounds size up to the next multiple of alignment, used for glBindBufferRange offsets
+inline GLsizeiptr AlignUp(GLsizeiptr size, GLsizeiptr alignment)
+{
+	return ((size + alignment - 1) / alignment) * alignment;
+}
+#endif
@@ -0,0 +1,72 @@
+#version 330 core
+
+layout (location = 0) out float FragColor;
+
+in vec2 TexCoords;
+
+#include "gbuffer.glsl"
+
+// permutation: COMPACT_GBUFFER
+//
+// Brute force reference for the AO benchmarks. Per pixel REFERENCE_DIRECTIONS x REFERENCE_DIRECTIONS rays, stratified
+// over the cosine weighted hemisphere around the normal, are marched REFERENCE_STEPS times each against the depth
+// buffer, out to the same radius ssao.frag and horizon_ao.frag use. A ray is blocked once a step lands behind the
+// depth buffer by less than the radius, and the visibility is the fraction of rays that are not. Neither the kernel
+// nor the horizon estimator is involved, so the reference favours neither of them.
+#ifndef REFERENCE_DIRECTIONS
+#define REFERENCE_DIRECTIONS 16
+#endif
+#ifndef REFERENCE_STEPS
+#define REFERENCE_STEPS 8
+#endif
+
+const float PI = 3.14159265358979323846;
+
+float radius = 0.5;
+float bias = 0.025;
+
+bool RayBlocked(vec3 fragPos, vec3 direction)
+{
+	for (int i = 0; i < REFERENCE_STEPS; i++)
+	{
+		vec3 samplePos = fragPos + direction * radius * (float(i) + 0.5) / float(REFERENCE_STEPS);
+
+		vec4 offset = projection * vec4(samplePos, 1.0);
+		vec2 uv = offset.xy / offset.w * 0.5 + 0.5;
+		// nothing is known about the scene off screen, so it doesn't occlude
+		if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0)))) return false;
+
+		float sampleDepth = GetViewDepth(uv);
+		if (sampleDepth >= samplePos.z + bias && sampleDepth - samplePos.z < radius) return true;
+	}
+	return false;
+}
+
+void main()
+{
+	vec3 fragPos = GetViewPosition(TexCoords);
+	vec3 normal = GetViewNormal(TexCoords);
+
+	// any tangent frame will do, the directions cover the whole hemisphere
+	vec3 helper = abs(normal.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+	vec3 T = normalize(cross(helper, normal));
+	vec3 B = cross(normal, T);
+	mat3 TBN = mat3(T, B, normal);
+
+	int visible = 0;
+	for (int ring = 0; ring < REFERENCE_DIRECTIONS; ring++)
+	{
+		// equal area rings of the projected disk, which is cosine weighting on the hemisphere
+		float u = (float(ring) + 0.5) / float(REFERENCE_DIRECTIONS);
+		float sinTheta = sqrt(u);
+		float cosTheta = sqrt(1.0 - u);
+		for (int sector = 0; sector < REFERENCE_DIRECTIONS; sector++)
+		{
+			float phi = 2.0 * PI * (float(sector) + 0.5) / float(REFERENCE_DIRECTIONS);
+			vec3 direction = TBN * vec3(sinTheta * cos(phi), sinTheta * sin(phi), cosTheta);
+			if (!RayBlocked(fragPos, direction)) visible++;
+		}
+	}
+
+	FragColor = float(visible) / float(REFERENCE_DIRECTIONS * REFERENCE_DIRECTIONS);
+}
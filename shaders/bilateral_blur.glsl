@@ -0,0 +1,39 @@
+#ifndef BILATERAL_BLUR_GLSL
+#define BILATERAL_BLUR_GLSL
+
+#include "gbuffer.glsl"
+
+// how fast the blur weight falls off with the relative depth difference, and with the angle between normals
+const float BLUR_DEPTH_SHARPNESS = 50.0;
+const float BLUR_NORMAL_SHARPNESS = 8.0;
+
+// One direction of the separable bilateral AO blur around pixel, whose view depth and normal are passed in. Every tap
+// is weighted by a gaussian of its distance, by how close its depth is to the center's and by how well its normal
+// agrees, so occlusion doesn't bleed across silhouettes or creases.
+float BilateralBlur(sampler2D occlusion, ivec2 pixel, ivec2 direction, int radius, float depth, vec3 normal)
+{
+	ivec2 size = textureSize(occlusion, 0);
+	float sigma = max(float(radius) * 0.5, 0.5);
+
+	float result = 0.0;
+	float weightSum = 0.0;
+	for (int i = -radius; i <= radius; i++)
+	{
+		ivec2 tap = clamp(pixel + direction * i, ivec2(0), size - 1);
+		vec2 tapUV = (vec2(tap) + 0.5) / vec2(size);
+
+		float weight = exp(-float(i * i) / (2.0 * sigma * sigma));
+		weight *= exp(-BLUR_DEPTH_SHARPNESS * abs(depth - GetViewDepth(tapUV)) / max(abs(depth), 0.001));
+		weight *= pow(max(dot(normal, GetViewNormal(tapUV)), 0.0), BLUR_NORMAL_SHARPNESS);
+
+		result += texelFetch(occlusion, tap, 0).r * weight;
+		weightSum += weight;
+	}
+
+	// The center tap's weight is close to 1 but not guaranteed: its normal is decoded again, and the caller's depth
+	// and normal may come from another source than the G-buffer. With no tap weighted in, keep the center's occlusion.
+	if (weightSum < 1e-4) return texelFetch(occlusion, clamp(pixel, ivec2(0), size - 1), 0).r;
+	return result / weightSum;
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef BILATERAL_UPSAMPLE_GLSL
+#define BILATERAL_UPSAMPLE_GLSL
+
+// keeps the weights finite where the depths match exactly
+const float DEPTH_EPSILON = 0.001;
+
+// Joint bilateral upsampling: the four low resolution texels around uv are blended with their bilinear weights,
+// scaled down by how far their depth is from the full resolution depth, so occlusion doesn't bleed across
+// silhouettes. lowResDepth holds the linear view depth the low resolution occlusion was computed on, 0 where it had
+// no surface; those texels get no weight, and where none of the four has a surface nothing is occluded.
+float BilateralUpsample(sampler2D lowResDepth, sampler2D lowResOcclusion, vec2 uv, float depth)
+{
+	ivec2 lowResSize = textureSize(lowResDepth, 0);
+	vec2 position = uv * vec2(lowResSize) - 0.5;
+	vec2 base = floor(position);
+	vec2 f = position - base;
+	float bilinear[4] = float[](
+		(1.0 - f.x) * (1.0 - f.y),
+		f.x * (1.0 - f.y),
+		(1.0 - f.x) * f.y,
+		f.x * f.y);
+
+	float occlusion = 0.0;
+	float weightSum = 0.0;
+	for (int i = 0; i < 4; i++)
+	{
+		ivec2 texel = clamp(ivec2(base) + ivec2(i & 1, i >> 1), ivec2(0), lowResSize - 1);
+		float sampleDepth = texelFetch(lowResDepth, texel, 0).r;
+		if (sampleDepth == 0.0) continue;
+
+		// relative difference, so the falloff is the same near and far from the camera
+		float depthDifference = abs(depth - sampleDepth) / max(abs(depth), DEPTH_EPSILON);
+		float weight = bilinear[i] / (DEPTH_EPSILON + depthDifference);
+
+		occlusion += texelFetch(lowResOcclusion, texel, 0).r * weight;
+		weightSum += weight;
+	}
+
+	return weightSum > 0.0 ? occlusion / weightSum : 1.0;
+}
+
+#endif
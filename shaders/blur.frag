@@ -4,21 +4,19 @@ layout (location = 0) out float FragColor;
 
 in vec2 TexCoords;
 
+#include "gbuffer.glsl"
+#include "bilateral_blur.glsl"
+
+// permutation: COMPACT_GBUFFER
+//
+// One pass of the separable bilateral AO blur, run across and then down: 2 * radius + 1 taps per pass instead of a
+// square kernel. With the fused blur only the pass across runs here and lighting_pass.frag does the one down.
+
 uniform sampler2D ssaoInput;
+uniform ivec2 direction;	// (1, 0) or (0, 1)
+uniform int radius;
 
 void main()
 {
-	vec2 texelSize = 1.0 / vec2(textureSize(ssaoInput, 0));
-	float result = 0.0;
-	
-	for (int x = -2; x < 2; x++) 
-	{
-		for(int y = -2; y < 2; y++)
-		{
-			vec2 offset = vec2(float(x), float(y)) * texelSize;
-			result += texture(ssaoInput, TexCoords + offset).r;
-		}
-	}
-
-	FragColor = result / (4.0 * 4.0);
-}
\ No newline at end of file
+	FragColor = BilateralBlur(ssaoInput, ivec2(gl_FragCoord.xy), direction, radius, GetViewDepth(TexCoords), GetViewNormal(TexCoords));
+}
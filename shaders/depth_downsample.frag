@@ -0,0 +1,15 @@
+#version 330 core
+
+layout (location = 0) out float LinearDepth;
+
+// the level above the one being written; its base level is set to that level so lod 0 addresses it
+uniform sampler2D previousLevel;
+
+void main()
+{
+	// Rotated grid subsample as in scalable ambient obscurance: every pixel takes one real depth of its 2x2 block
+	// instead of an average that would not lie on any surface, alternating which one so no axis is favored.
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	ivec2 source = texel * 2 + ivec2(texel.y & 1, texel.x & 1);
+	LinearDepth = texelFetch(previousLevel, min(source, textureSize(previousLevel, 0) - 1), 0).r;
+}
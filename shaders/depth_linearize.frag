@@ -0,0 +1,15 @@
+#version 330 core
+
+layout (location = 0) out float LinearDepth;
+
+in vec2 TexCoords;
+
+#include "gbuffer.glsl"
+
+// permutation: COMPACT_GBUFFER
+
+// level 0 of the depth pyramid: view space z of every gBuffer pixel
+void main()
+{
+	LinearDepth = GetViewDepth(TexCoords);
+}
@@ -0,0 +1,18 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos;
+
+layout (std140) uniform ObjectData
+{
+	mat4 model;
+	mat4 mv;
+	mat4 mvp;
+	mat3 normalMatrix;
+};
+
+invariant gl_Position;
+
+void main()
+{
+	gl_Position = mvp * vec4(aPos, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,17 @@
+#ifndef FRAME_DATA_GLSL
+#define FRAME_DATA_GLSL
+
+// camera constants written once per frame, mirrored by FrameUniforms in UniformBuffer.h
+layout (std140) uniform FrameData
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	mat4 inverseProjection;
+	vec4 cameraPosition;
+	vec4 screenSize;	// xy: render target size in pixels, zw: 1 / size
+	vec4 temporalJitter;	// x: rotation of the SSAO noise this frame, y: first kernel sample, z: kernel stride,
+				// w: checkerboard colour rendered this frame
+};
+
+#endif
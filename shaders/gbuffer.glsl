@@ -0,0 +1,91 @@
+#ifndef GBUFFER_GLSL
+#define GBUFFER_GLSL
+
+#include "frame_data.glsl"
+#include "octahedral.glsl"
+
+// permutations: COMPACT_GBUFFER, DOWNSAMPLED_GBUFFER
+//
+// Full layout:        gPosition RGBA16F view space position, gNormal RGBA16F view space normal
+// Compact layout:     gDepth sampleable depth texture, gNormal RG16_SNORM octahedral encoded normal
+// Downsampled layout: gDepth R32F linear view space depth, gNormal RG16F octahedral encoded normal, written by
+//                     ssao_downsample.frag for reduced resolution SSAO. Takes precedence over COMPACT_GBUFFER.
+//                     Like the full layout, a depth of 0 marks a pixel with no surface.
+// The full and compact layouts also store albedo and specular in gAlbedo. Passes read the G-buffer only through the
+// functions below. Every layout has a single level, fetched with textureLod so the functions stay defined in non
+// uniform control flow such as the early out of adaptive SSAO.
+
+// view space position of the pixel at uv with view space depth z. Only the diagonal of the projection is needed.
+vec3 ViewPositionFromDepth(vec2 uv, float z)
+{
+	vec2 ndc = uv * 2.0 - 1.0;
+	return vec3(ndc * -z / vec2(projection[0][0], projection[1][1]), z);
+}
+
+#if defined(DOWNSAMPLED_GBUFFER)
+
+uniform sampler2D gDepth;
+uniform sampler2D gNormal;
+
+float GetViewDepth(vec2 uv)
+{
+	return textureLod(gDepth, uv, 0.0).r;
+}
+
+vec3 GetViewPosition(vec2 uv)
+{
+	return ViewPositionFromDepth(uv, GetViewDepth(uv));
+}
+
+vec3 GetViewNormal(vec2 uv)
+{
+	return DecodeNormal(textureLod(gNormal, uv, 0.0).xy);
+}
+
+#elif defined(COMPACT_GBUFFER)
+
+uniform sampler2D gDepth;
+uniform sampler2D gNormal;
+
+// view space z of a depth buffer value, only needs two entries of the projection
+float GetViewDepth(vec2 uv)
+{
+	float ndcDepth = textureLod(gDepth, uv, 0.0).r * 2.0 - 1.0;
+	return -projection[3][2] / (ndcDepth + projection[2][2]);
+}
+
+vec3 GetViewPosition(vec2 uv)
+{
+	vec4 clip = vec4(vec3(uv, textureLod(gDepth, uv, 0.0).r) * 2.0 - 1.0, 1.0);
+	vec4 viewPos = inverseProjection * clip;
+	return viewPos.xyz / viewPos.w;
+}
+
+vec3 GetViewNormal(vec2 uv)
+{
+	return DecodeNormal(textureLod(gNormal, uv, 0.0).xy);
+}
+
+#else
+
+uniform sampler2D gPosition;
+uniform sampler2D gNormal;
+
+float GetViewDepth(vec2 uv)
+{
+	return textureLod(gPosition, uv, 0.0).z;
+}
+
+vec3 GetViewPosition(vec2 uv)
+{
+	return textureLod(gPosition, uv, 0.0).xyz;
+}
+
+vec3 GetViewNormal(vec2 uv)
+{
+	return normalize(textureLod(gNormal, uv, 0.0).xyz);
+}
+
+#endif
+
+#endif
@@ -1,7 +1,14 @@
 #version 330 core
+#include "octahedral.glsl"
+
+#ifdef COMPACT_GBUFFER
+layout (location = 0) out vec2 gNormal;
+layout (location = 1) out vec4 gAlbedo;
+#else
 layout (location = 0) out vec3 gPosition;
 layout (location = 1) out vec3 gNormal;
 layout (location = 2) out vec4 gAlbedo;
+#endif
 
 in vec2 TexCoords;
 in vec3 FragPos;
@@ -9,21 +16,24 @@ in vec3 Normals;
 
 uniform sampler2D texture_diffuse1;
 uniform sampler2D texture_specular1;
-uniform bool readTexture;
+
+// permutations: READ_TEXTURE, COMPACT_GBUFFER
 
 void main()
 {
+#ifdef COMPACT_GBUFFER
+	// position is reconstructed from the depth buffer by the passes reading the gBuffer
+	gNormal = EncodeNormal(normalize(Normals));
+#else
 	gPosition = FragPos;
 	gNormal = normalize(Normals);
+#endif
 
-	if(readTexture)
-	{
-		gAlbedo.rgb = texture(texture_diffuse1, TexCoords).rgb;
-		gAlbedo.a = texture(texture_specular1, TexCoords).r;
-	}
-	else
-	{
-		gAlbedo = vec4(0.95f, 0.95f, 0.95f, 1.0);
-	}
+#ifdef READ_TEXTURE
+	gAlbedo.rgb = texture(texture_diffuse1, TexCoords).rgb;
+	gAlbedo.a = texture(texture_specular1, TexCoords).r;
+#else
+	gAlbedo = vec4(0.95f, 0.95f, 0.95f, 1.0);
+#endif
 	
 }
\ No newline at end of file
@@ -8,11 +8,18 @@ out vec3 FragPos;
 out vec2 TexCoords;
 out vec3 Normals;
 
-uniform bool invertedNormals;
-uniform bool invertedAxisYZ;
+// must match depth_prepass.vert bit for bit so the GL_EQUAL depth test passes after a depth pre-pass
+invariant gl_Position;
 
-uniform mat4 mvp;
-uniform mat4 mv;
+// permutation: INVERTED_NORMALS
+
+layout (std140) uniform ObjectData
+{
+	mat4 model;
+	mat4 mv;
+	mat4 mvp;
+	mat3 normalMatrix;	// inverse transpose of mat3(mv), computed on the CPU once per object
+};
 
 
 void main()
@@ -23,8 +30,11 @@ void main()
 		FragPos = viewPos.xyz;
 		TexCoords = aTexCoords;
 
-		mat3 normalMatrix = transpose(inverse(mat3(mv)));
-		Normals = normalMatrix * (invertedNormals ? -aNormals : aNormals);
+#ifdef INVERTED_NORMALS
+		Normals = normalMatrix * -aNormals;
+#else
+		Normals = normalMatrix * aNormals;
+#endif
 
 		gl_Position = mvp * vec4(aPos, 1.0);
 	
@@ -0,0 +1,97 @@
+#version 330 core
+
+layout (location = 0) out float FragColor;
+
+in vec2 TexCoords;
+
+#include "gbuffer.glsl"
+
+uniform sampler2D texNoise;
+
+// permutations: COMPACT_GBUFFER, DOWNSAMPLED_GBUFFER
+//
+// Ground truth ambient occlusion (Jimenez et al. 2016). Per pixel HORIZON_SLICES screen space directions are marched
+// HORIZON_STEPS times each way against the depth buffer to find the highest horizon on both sides; the cosine
+// weighted visibility between the two horizons is then integrated analytically, so a handful of fetches per direction
+// is enough where the hemisphere kernel needs many random ones.
+#ifndef HORIZON_SLICES
+#define HORIZON_SLICES 2
+#endif
+#ifndef HORIZON_STEPS
+#define HORIZON_STEPS 4
+#endif
+
+const float PI = 3.14159265358979323846;
+const float HALF_PI = PI * 0.5;
+
+// same world space radius as the kernel in ssao.frag; samples fade out over the outer part of it
+float radius = 0.5;
+float falloffRange = 0.615 * radius;
+
+void main()
+{
+	vec3 fragPos = GetViewPosition(TexCoords);
+	vec3 normal = GetViewNormal(TexCoords);
+	vec3 viewVec = normalize(-fragPos);
+
+	// the noise rotates the slices and offsets the steps of neighbouring pixels
+	vec2 noiseScale = vec2(textureSize(gNormal, 0)) / vec2(textureSize(texNoise, 0));
+	vec2 noise = texture(texNoise, TexCoords * noiseScale).xy * 0.5 + 0.5;
+
+	// radius projected to texture coordinates at this pixel's depth
+	vec2 screenRadius = 0.5 * radius * vec2(projection[0][0], projection[1][1]) / -fragPos.z;
+
+	float visibility = 0.0;
+	for (int slice = 0; slice < HORIZON_SLICES; slice++)
+	{
+		float phi = (float(slice) + noise.x) * PI / float(HORIZON_SLICES);
+		vec2 omega = vec2(cos(phi), sin(phi));
+
+		// the slice is the plane through the view vector and the screen direction; project the normal into it
+		vec3 directionVec = vec3(omega, 0.0);
+		vec3 orthoDirectionVec = directionVec - dot(directionVec, viewVec) * viewVec;
+		vec3 axisVec = normalize(cross(orthoDirectionVec, viewVec));
+		vec3 projectedNormal = normal - axisVec * dot(normal, axisVec);
+		float projectedNormalLength = length(projectedNormal);
+
+		float signNormal = sign(dot(orthoDirectionVec, projectedNormal));
+		float cosNormal = clamp(dot(projectedNormal, viewVec) / projectedNormalLength, 0.0, 1.0);
+		float n = signNormal * acos(cosNormal);
+
+		// start at the tangent plane, which is as low as a horizon can meaningfully be
+		float lowHorizonCos0 = cos(n + HALF_PI);
+		float lowHorizonCos1 = cos(n - HALF_PI);
+		float horizonCos0 = lowHorizonCos0;
+		float horizonCos1 = lowHorizonCos1;
+
+		for (int i = 0; i < HORIZON_STEPS; i++)
+		{
+			float t = (float(i) + noise.y) / float(HORIZON_STEPS);
+			vec2 offset = omega * screenRadius * t;
+
+			vec3 delta0 = GetViewPosition(TexCoords + offset) - fragPos;
+			vec3 delta1 = GetViewPosition(TexCoords - offset) - fragPos;
+			float distance0 = max(length(delta0), 1e-4);
+			float distance1 = max(length(delta1), 1e-4);
+
+			// far away samples fade back to the low horizon instead of occluding
+			float weight0 = clamp((radius - distance0) / falloffRange, 0.0, 1.0);
+			float weight1 = clamp((radius - distance1) / falloffRange, 0.0, 1.0);
+
+			horizonCos0 = max(horizonCos0, mix(lowHorizonCos0, dot(delta0 / distance0, viewVec), weight0));
+			horizonCos1 = max(horizonCos1, mix(lowHorizonCos1, dot(delta1 / distance1, viewVec), weight1));
+		}
+
+		float h0 = -acos(horizonCos1);
+		float h1 = acos(horizonCos0);
+		h0 = n + clamp(h0 - n, -HALF_PI, HALF_PI);
+		h1 = n + clamp(h1 - n, -HALF_PI, HALF_PI);
+
+		// cosine weighted integral of the visible arc on both sides
+		float arc0 = (cosNormal + 2.0 * h0 * sin(n) - cos(2.0 * h0 - n)) / 4.0;
+		float arc1 = (cosNormal + 2.0 * h1 * sin(n) - cos(2.0 * h1 - n)) / 4.0;
+		visibility += projectedNormalLength * (arc0 + arc1);
+	}
+
+	FragColor = clamp(visibility / float(HORIZON_SLICES), 0.0, 1.0);
+}
@@ -1,16 +1,22 @@
-#version 330 core
+#version 430 core
 
 layout (location = 0) out vec4 FragColor;
 
 in vec2 TexCoords;
 
-uniform sampler2D gPosition;
-uniform sampler2D gNormal;
+#include "gbuffer.glsl"
+
 uniform sampler2D gAlbedo;
 uniform sampler2D ssao;
 
-uniform bool ambientOcclusionOn;
-uniform bool attenuationOn;
+// permutations: AMBIENT_OCCLUSION, ATTENUATION, COMPACT_GBUFFER, MANY_LIGHTS, FUSED_BLUR
+
+#ifdef FUSED_BLUR
+// ssao holds the pass across of the bilateral blur; the pass down runs here, on the depth and normal the lighting reads
+// anyway, instead of through another full screen target
+#include "bilateral_blur.glsl"
+uniform int blurRadius;
+#endif
 
 struct Light {
 	vec3 Position;
@@ -18,17 +24,83 @@ struct Light {
 
 };
 
-uniform Light light;
+layout (std140) uniform LightData
+{
+	Light light;
+};
+
+#ifdef MANY_LIGHTS
+// point lights binned into view space clusters on the CPU, see LightClusters.h
+struct PointLight {
+	vec4 PositionRadius;	// view space position, w: radius
+	vec4 Color;
+};
+
+layout (std430) readonly buffer LightList
+{
+	PointLight pointLights[];
+};
+
+layout (std430) readonly buffer ClusterList
+{
+	uvec2 clusters[];	// offset into lightIndices, light count
+};
+
+layout (std430) readonly buffer LightIndexList
+{
+	uint lightIndices[];
+};
+
+layout (std140) uniform ClusterData
+{
+	uvec4 clusterGrid;	// tiles across, tiles up, depth slices, light count
+	vec4 clusterDepth;	// near, slices / log(far / near), far
+};
+
+// Blinn-Phong of every light in the pixel's cluster, with a falloff that reaches zero at the light's radius
+vec3 ShadePointLights(vec3 FragPos, vec3 Normal, vec3 Diffuse, vec3 viewDir)
+{
+	float depth = -FragPos.z;
+	if (depth < clusterDepth.x || depth >= clusterDepth.z) return vec3(0.0);
+
+	uvec2 tile = min(uvec2(TexCoords * vec2(clusterGrid.xy)), clusterGrid.xy - 1u);
+	uint slice = min(uint(log(depth / clusterDepth.x) * clusterDepth.y), clusterGrid.z - 1u);
+	uvec2 cluster = clusters[(slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x];
+
+	vec3 result = vec3(0.0);
+	for (uint i = 0u; i < cluster.y; i++)
+	{
+		PointLight pointLight = pointLights[lightIndices[cluster.x + i]];
+
+		vec3 toLight = pointLight.PositionRadius.xyz - FragPos;
+		float dist = length(toLight);
+		float window = clamp(1.0 - pow(dist / pointLight.PositionRadius.w, 4.0), 0.0, 1.0);
+		float attenuation = window * window / (1.0 + dist * dist);
+
+		vec3 lightDir = toLight / max(dist, 1e-4);
+		float geometryTerm = max(dot(Normal, lightDir), 0.0);
+		float specularTerm = max(0.0, dot(Normal, normalize(lightDir + viewDir)));
+		result += (geometryTerm * Diffuse + pow(specularTerm, 32.0)) * pointLight.Color.rgb * attenuation;
+	}
+	return result;
+}
+#endif
 
 void main()
 {
-	vec3 FragPos = texture(gPosition, TexCoords).rgb;
-	vec3 Normal = texture(gNormal, TexCoords).rgb;
+	vec3 FragPos = GetViewPosition(TexCoords);
+	vec3 Normal = GetViewNormal(TexCoords);
 	vec3 Diffuse = texture(gAlbedo, TexCoords).rgb;
-	float AmbientOcclusion = texture(ssao, TexCoords).r;
 
-	
-	vec3 ambient = ambientOcclusionOn ? vec3(0.3 * Diffuse * AmbientOcclusion) : vec3(0.3 * Diffuse);
+#if defined(AMBIENT_OCCLUSION) && defined(FUSED_BLUR)
+	float AmbientOcclusion = BilateralBlur(ssao, ivec2(gl_FragCoord.xy), ivec2(0, 1), blurRadius, FragPos.z, Normal);
+	vec3 ambient = vec3(0.3 * Diffuse * AmbientOcclusion);
+#elif defined(AMBIENT_OCCLUSION)
+	float AmbientOcclusion = texture(ssao, TexCoords).r;
+	vec3 ambient = vec3(0.3 * Diffuse * AmbientOcclusion);
+#else
+	vec3 ambient = vec3(0.3 * Diffuse);
+#endif
 	vec3 viewDir = normalize(-FragPos);
 
 	vec3 lightDir = normalize(light.Position - FragPos);
@@ -40,17 +112,20 @@ void main()
 	float specularTerm = max(0.0, dot(Normal, halfAngle));
 	vec3 specular = pow(specularTerm, shininess) * light.Color;
 
+#ifdef ATTENUATION
 	float linear = 0.09f;
 	float quadratic = 0.032f;
 	float dist = length(light.Position - FragPos);
 	float attenuation = 1.0 / (1.0 + linear * dist * quadratic * dist * dist);
 
-	if (attenuationOn)
-	{
-		diffuse *= attenuation;
-		specular *= attenuation;
-	}
-	
+	diffuse *= attenuation;
+	specular *= attenuation;
+#endif
+
+
+#ifdef MANY_LIGHTS
+	diffuse += ShadePointLights(FragPos, Normal, Diffuse, viewDir);
+#endif
 
 	FragColor = vec4(ambient + diffuse + specular, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,26 @@
+#ifndef OCTAHEDRAL_GLSL
+#define OCTAHEDRAL_GLSL
+
+// unit vectors packed into two components, used for the normals of the compact G-buffer
+
+vec2 SignNotZero(vec2 v)
+{
+	return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// projects the unit normal onto the octahedron |x| + |y| + |z| = 1 and folds the lower half over the upper one
+vec2 EncodeNormal(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	return n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * SignNotZero(n.xy);
+}
+
+vec3 DecodeNormal(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float fold = max(-n.z, 0.0);
+	n.xy -= fold * SignNotZero(n.xy);
+	return normalize(n);
+}
+
+#endif
@@ -1,53 +1,189 @@
-#version 330 core
+#version 430 core
 
 layout (location = 0) out float FragColor;
 
 in vec2 TexCoords;
 
-uniform sampler2D gPosition;
-uniform sampler2D gNormal;
+#include "gbuffer.glsl"
+
 uniform sampler2D texNoise;
 
-uniform vec3 samples[64];
-uniform mat4 projection;
-uniform float windowWidth;
-uniform float windowHeight;
+// compile time constant so the sample loop can be fully unrolled
+#ifndef KERNEL_SIZE
+#define KERNEL_SIZE 64
+#endif
+
+// permutation: TEMPORAL
+#ifdef TEMPORAL
+// Every frame runs only TEMPORAL_SAMPLES of the kernel, every stride-th sample starting at temporalJitter.y, with the
+// noise rotated by temporalJitter.x. ssao_temporal.frag accumulates the frames, so over a few of them every sample
+// of the kernel is taken at many rotations.
+#ifndef TEMPORAL_SAMPLES
+#define TEMPORAL_SAMPLES 16
+#endif
+const int SAMPLE_COUNT = TEMPORAL_SAMPLES;
+#else
+const int SAMPLE_COUNT = KERNEL_SIZE;
+#endif
+
+uniform vec3 samples[KERNEL_SIZE];
+
+// permutation: DEPTH_PYRAMID
+#ifdef DEPTH_PYRAMID
+// linear view depth with DEPTH_PYRAMID_LEVELS mip levels. Samples within 2^LOG_MAX_OFFSET pixels read level 0, every
+// doubling of the distance beyond that moves one level up, so far apart samples stay close together in memory.
+uniform sampler2D depthPyramid;
+const int LOG_MAX_OFFSET = 3;
+#endif
+
+// permutation: DEINTERLEAVED
+#ifdef DEINTERLEAVED
+// Renders one layer of a 4x4 deinterleaved SSAO: every pixel of the layer stands for the full resolution pixel at
+// 4 * pixel + (layer % 4, layer / 4), all of them share the single noise rotation that offset gets from texNoise, and
+// every sample reads this layer's quarter resolution copy of the depth. Takes precedence over DEPTH_PYRAMID.
+uniform sampler2DArray deinterleavedDepth;
+uniform int layer;
+uniform vec3 rotation;
+#endif
+
+// permutation: CHECKERBOARD
+// Renders one colour of a checkerboard into a half width target: pixel x of row y stands for the full resolution pixel
+// 2x + (y + temporalJitter.w) % 2, so the colour alternates every frame. ssao_checkerboard.frag fills in the other one.
 
-float kernelSize = 64;
-float radius = 0.5;
+// permutation: ADAPTIVE
+#ifdef ADAPTIVE
+// Samples are taken in batches of ADAPTIVE_BATCH, each batch spread over the whole kernel. The projected size of the
+// kernel caps the number of batches, since a kernel only a few pixels across can't resolve 64 samples worth of
+// detail. After every batch the pixel stops once the standard error of its estimate is below ADAPTIVE_TOLERANCE,
+// which on open flat surfaces, where every sample agrees, happens after the first one.
+#ifndef ADAPTIVE_BATCH
+#define ADAPTIVE_BATCH 8
+#endif
+const float ADAPTIVE_TOLERANCE = 0.03;
+const float FULL_KERNEL_PIXELS = 64.0;	// projected kernel radius in pixels that gets every batch
+
+// pixels per number of batches taken, counted while recordSampleCounts is set
+uniform bool recordSampleCounts;
+layout (std430) buffer SampleHistogram
+{
+	uint sampleCounts[];
+};
+#endif
+
+// world space radius of the kernel. Multi-scale AO also sets innerRadius, the fraction of it the samples start at, so
+// each scale only covers the shell beyond the finer one.
+uniform float radius;
+uniform float innerRadius;
 float bias = 0.025;
 
+// occlusion by kernel sample index around fragPos: 1 when the depth buffer is in front of it, faded out beyond radius
+float SampleOcclusion(vec3 fragPos, mat3 TBN, vec2 uv, int index)
+{
+	vec3 kernelSample = samples[index];
+	float kernelDistance = length(kernelSample);
+	kernelSample *= (innerRadius + (1.0 - innerRadius) * kernelDistance) / max(kernelDistance, 1e-4);
+
+	vec3 samplePos = TBN * kernelSample;
+	samplePos = fragPos + samplePos * radius;
+
+	vec4 offset = vec4(samplePos, 1.0);
+	offset = projection * offset;
+	offset.xyz /= offset.w;
+	offset.xyz = offset.xyz * 0.5 + 0.5;
+
+#if defined(DEINTERLEAVED)
+	// nearest pixel of this layer's grid
+	vec2 layerOffset = vec2(layer % 4, layer / 4);
+	vec2 layerSize = vec2(textureSize(deinterleavedDepth, 0).xy);
+	vec2 layerUV = ((offset.xy * screenSize.xy - layerOffset - 0.5) / 4.0 + 0.5) / layerSize;
+	float sampleDepth = textureLod(deinterleavedDepth, vec3(layerUV, float(layer)), 0.0).r;
+#elif defined(DEPTH_PYRAMID)
+	float screenDistance = length((offset.xy - uv) * vec2(textureSize(depthPyramid, 0)));
+	int mip = clamp(int(floor(log2(max(screenDistance, 1.0)))) - LOG_MAX_OFFSET, 0, DEPTH_PYRAMID_LEVELS - 1);
+	float sampleDepth = textureLod(depthPyramid, offset.xy, float(mip)).r;
+#else
+	float sampleDepth = GetViewDepth(offset.xy);
+#endif
+
+	float rangeCheck = smoothstep(0.0, 1.0, radius / abs(fragPos.z - sampleDepth));
+	return (sampleDepth >= samplePos.z + bias ? 1.0 : 0.0) * rangeCheck;
+}
+
 void main()
 {
 
-	vec3 fragPos = texture(gPosition, TexCoords).xyz;
-	vec3 normal = normalize(texture(gNormal, TexCoords).rgb);
+#ifdef DEINTERLEAVED
+	vec2 layerOffset = vec2(layer % 4, layer / 4);
+	vec2 uv = (floor(gl_FragCoord.xy) * 4.0 + layerOffset + 0.5) * screenSize.zw;
+
+	vec3 fragPos = ViewPositionFromDepth(uv, texelFetch(deinterleavedDepth, ivec3(gl_FragCoord.xy, layer), 0).r);
+	vec3 normal = GetViewNormal(uv);
+	vec3 randomVec = normalize(rotation);
+#else
+#ifdef CHECKERBOARD
+	vec2 pixel = floor(gl_FragCoord.xy);
+	pixel.x = pixel.x * 2.0 + float((int(pixel.y) + int(temporalJitter.w)) & 1);
+	vec2 uv = (pixel + 0.5) * screenSize.zw;
+#else
+	vec2 uv = TexCoords;
+#endif
+	vec3 fragPos = GetViewPosition(uv);
+	vec3 normal = GetViewNormal(uv);
 
-	vec2 noiseScale = vec2(windowWidth / 4.0, windowHeight / 4.0);
-	vec3 randomVec = normalize(texture(texNoise, TexCoords * noiseScale).xyz);
+	// tile the noise over the target this pass renders, which is smaller than the screen at reduced resolution
+	vec2 noiseScale = vec2(textureSize(gNormal, 0)) / vec2(textureSize(texNoise, 0));
+	vec3 randomVec = normalize(texture(texNoise, uv * noiseScale).xyz);
+#endif
+
+#ifdef TEMPORAL
+	// the noise vectors lie in the xy plane, so rotating them there turns the kernel around the normal
+	float angle = temporalJitter.x;
+	randomVec.xy = mat2(cos(angle), sin(angle), -sin(angle), cos(angle)) * randomVec.xy;
+	int firstSample = int(temporalJitter.y);
+	int sampleStride = int(temporalJitter.z);
+#else
+	const int firstSample = 0;
+	const int sampleStride = 1;
+#endif
 
 	vec3 T = normalize(randomVec - normal * dot(randomVec, normal));
 	vec3 B = cross(normal, T);
 	mat3 TBN = mat3(T, B, normal);
 
 	float occlusion = 0.0;
-	for(int i = 0; i < kernelSize; i++)
-	{
-		vec3 samplePos = TBN * samples[i];
-		samplePos = fragPos + samplePos * radius;
+#ifdef ADAPTIVE
+	const int BATCHES = SAMPLE_COUNT / ADAPTIVE_BATCH;
+	float projectedRadius = radius * projection[1][1] / -fragPos.z * 0.5 * float(textureSize(gNormal, 0).y);
+	int batchBudget = clamp(int(ceil(float(BATCHES) * projectedRadius / FULL_KERNEL_PIXELS)), 1, BATCHES);
 
-		vec4 offset = vec4(samplePos, 1.0);
-		offset = projection * offset;
-		offset.xyz /= offset.w;
-		offset.xyz = offset.xyz * 0.5 + 0.5;
+	int taken = 0;
+	float squaredSum = 0.0;
+	for (int batch = 0; batch < batchBudget; batch++)
+	{
+		// every BATCHES-th sample, so each batch covers the short and the long samples of the kernel
+		for (int i = 0; i < ADAPTIVE_BATCH; i++)
+		{
+			float sampleOcclusion = SampleOcclusion(fragPos, TBN, uv, firstSample + (i * BATCHES + batch) * sampleStride);
+			occlusion += sampleOcclusion;
+			squaredSum += sampleOcclusion * sampleOcclusion;
+		}
+		taken += ADAPTIVE_BATCH;
 
-		float sampleDepth = texture(gPosition, offset.xy).z;
+		float mean = occlusion / float(taken);
+		float variance = max(squaredSum / float(taken) - mean * mean, 0.0);
+		if (sqrt(variance / float(taken)) < ADAPTIVE_TOLERANCE) break;
+	}
 
-		float rangeCheck = smoothstep(0.0, 1.0, radius / abs(fragPos.z - sampleDepth));
-		occlusion += (sampleDepth >= samplePos.z + bias ? 1.0 : 0.0) * rangeCheck;
+	if (recordSampleCounts) atomicAdd(sampleCounts[taken / ADAPTIVE_BATCH - 1], 1u);
+	occlusion = 1.0 - (occlusion / float(taken));
+#else
+	for(int i = 0; i < SAMPLE_COUNT; i++)
+	{
+		occlusion += SampleOcclusion(fragPos, TBN, uv, firstSample + i * sampleStride);
 	}
 
-	occlusion = 1.0 - (occlusion / kernelSize);
+	occlusion = 1.0 - (occlusion / float(SAMPLE_COUNT));
+#endif
 
 	FragColor = occlusion;
 }
\ No newline at end of file
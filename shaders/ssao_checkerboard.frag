@@ -0,0 +1,78 @@
+#version 330 core
+
+layout (location = 0) out float FragColor;
+layout (location = 1) out vec2 History;	// x: occlusion, y: linear view depth, read back by the next frame
+
+in vec2 TexCoords;
+
+#include "gbuffer.glsl"
+
+// permutation: COMPACT_GBUFFER
+
+uniform sampler2D halfOcclusion;	// this frame's checkerboard colour, half the width, see ssao.frag
+uniform sampler2D history;
+uniform mat4 reprojection;	// this frame's view space to last frame's clip space
+uniform bool historyValid;
+
+// relative depth difference beyond which the reprojected history belongs to a different surface
+const float DISOCCLUSION_THRESHOLD = 0.02;
+
+// keeps the weights finite where the depths match exactly
+const float DEPTH_EPSILON = 0.001;
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	ivec2 halfSize = textureSize(halfOcclusion, 0);
+	int parity = int(temporalJitter.w);
+	vec3 position = GetViewPosition(TexCoords);
+
+	float occlusion;
+	if (((pixel.x + pixel.y + parity) & 1) == 0)
+	{
+		// rendered this frame
+		occlusion = texelFetch(halfOcclusion, ivec2(pixel.x >> 1, pixel.y), 0).r;
+	}
+	else
+	{
+		// The four direct neighbours were all rendered this frame. They are weighted by how close their depth is to
+		// this pixel's, so occlusion doesn't leak across silhouettes.
+		ivec2 offsets[4] = ivec2[](ivec2(-1, 0), ivec2(1, 0), ivec2(0, -1), ivec2(0, 1));
+		float spatial = 0.0;
+		float weightSum = 0.0;
+		float lowest = 1.0, highest = 0.0;
+		for (int i = 0; i < 4; i++)
+		{
+			ivec2 neighbour = pixel + offsets[i];
+			// off the edge, the neighbour on the other side is used twice
+			if (neighbour.x < 0 || neighbour.x >= int(screenSize.x)) neighbour.x = pixel.x - offsets[i].x;
+			if (neighbour.y < 0 || neighbour.y >= int(screenSize.y)) neighbour.y = pixel.y - offsets[i].y;
+
+			float neighbourDepth = GetViewDepth((vec2(neighbour) + 0.5) * screenSize.zw);
+			float neighbourOcclusion = texelFetch(halfOcclusion, clamp(ivec2(neighbour.x >> 1, neighbour.y), ivec2(0), halfSize - 1), 0).r;
+
+			// relative difference, so the falloff is the same near and far from the camera
+			float depthDifference = abs(position.z - neighbourDepth) / max(abs(position.z), DEPTH_EPSILON);
+			float weight = 1.0 / (DEPTH_EPSILON + depthDifference);
+			spatial += neighbourOcclusion * weight;
+			weightSum += weight;
+			lowest = min(lowest, neighbourOcclusion);
+			highest = max(highest, neighbourOcclusion);
+		}
+		occlusion = spatial / max(weightSum, 1e-6);
+
+		// Last frame rendered this pixel, or reconstructed it from pixels it rendered. Where the surface is still
+		// the same the history is the better value, clamped to the neighbours so stale occlusion can't linger.
+		vec4 previous = reprojection * vec4(position, 1.0);
+		vec2 previousUV = previous.xy / previous.w * 0.5 + 0.5;
+		if (historyValid && all(greaterThanEqual(previousUV, vec2(0.0))) && all(lessThanEqual(previousUV, vec2(1.0))))
+		{
+			vec2 previousHistory = texture(history, previousUV).rg;
+			if (abs(previousHistory.y - previous.w) < DISOCCLUSION_THRESHOLD * previous.w)
+				occlusion = clamp(previousHistory.x, lowest, highest);
+		}
+	}
+
+	FragColor = occlusion;
+	History = vec2(occlusion, -position.z);
+}
@@ -0,0 +1,23 @@
+#version 330 core
+
+// eight of the sixteen layers per draw, the most color attachments every GL 3.3 implementation supports
+layout (location = 0) out float LayerDepth[8];
+
+#include "gbuffer.glsl"
+
+// permutation: COMPACT_GBUFFER
+
+uniform int firstLayer;
+
+// Splits the view space depth into 4x4 quarter resolution layers: layer (x % 4) + (y % 4) * 4 holds pixel (x, y)
+// at (x / 4, y / 4)
+void main()
+{
+	vec2 pixel = floor(gl_FragCoord.xy) * 4.0;
+	for (int i = 0; i < 8; i++)
+	{
+		int layer = firstLayer + i;
+		vec2 uv = (pixel + vec2(layer % 4, layer / 4) + 0.5) * screenSize.zw;
+		LayerDepth[i] = GetViewDepth(uv);
+	}
+}
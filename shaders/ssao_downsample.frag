@@ -0,0 +1,48 @@
+#version 330 core
+
+layout (location = 0) out float LinearDepth;
+layout (location = 1) out vec2 PackedNormal;
+
+#include "gbuffer.glsl"
+
+// permutation: COMPACT_GBUFFER
+
+// size of the block of full resolution pixels one output pixel covers
+uniform int divisor;
+
+void main()
+{
+	// Pick one of the 2x2 pixels at the center of the block instead of averaging them, so depth and normal always
+	// belong to a real surface. The nearest pixel that holds a surface wins; empty ones only when all four are.
+	vec2 blockCenter = gl_FragCoord.xy * float(divisor);
+
+	float bestDepth = 0.0;
+	vec2 bestUV = blockCenter * screenSize.zw;
+	for (int i = 0; i < 4; i++)
+	{
+		vec2 uv = (blockCenter + vec2(i & 1, i >> 1) - 0.5) * screenSize.zw;
+		float depth = GetViewDepth(uv);
+#if !defined(COMPACT_GBUFFER)
+		// the full layout leaves gPosition cleared to 0 where nothing was drawn, which would be nearer than anything
+		if (depth == 0.0) depth = -1e30;
+#endif
+		if (i == 0 || depth > bestDepth)
+		{
+			bestDepth = depth;
+			bestUV = uv;
+		}
+	}
+
+#if !defined(COMPACT_GBUFFER)
+	// an empty block stays empty, with a normal that decodes instead of the NaN of normalize(vec3(0))
+	if (bestDepth == -1e30)
+	{
+		LinearDepth = 0.0;
+		PackedNormal = EncodeNormal(vec3(0.0, 0.0, 1.0));
+		return;
+	}
+#endif
+
+	LinearDepth = bestDepth;
+	PackedNormal = EncodeNormal(GetViewNormal(bestUV));
+}
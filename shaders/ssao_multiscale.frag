@@ -0,0 +1,34 @@
+#version 430 core
+
+layout (location = 0) out float FragColor;
+
+in vec2 TexCoords;
+
+#include "gbuffer.glsl"
+#include "bilateral_upsample.glsl"
+
+// permutation: COMPACT_GBUFFER
+//
+// Combines the scales of multi-scale AO. The finest scale is at full resolution; every coarser one was computed at
+// half the resolution of the one before with twice its radius, from the shell beyond the previous radius only. Light
+// reaching the surface has to get past every shell, so the visibilities multiply.
+#ifndef AO_SCALES
+#define AO_SCALES 3
+#endif
+
+uniform sampler2D fineOcclusion;
+uniform sampler2D coarseDepth[AO_SCALES - 1];	// linear view depth each coarse scale ran on
+uniform sampler2D coarseOcclusion[AO_SCALES - 1];
+
+void main()
+{
+	float depth = GetViewDepth(TexCoords);
+
+	float visibility = texture(fineOcclusion, TexCoords).r;
+	for (int i = 0; i < AO_SCALES - 1; i++)
+	{
+		visibility *= BilateralUpsample(coarseDepth[i], coarseOcclusion[i], TexCoords, depth);
+	}
+
+	FragColor = visibility;
+}
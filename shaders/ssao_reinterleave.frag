@@ -0,0 +1,12 @@
+#version 330 core
+
+layout (location = 0) out float FragColor;
+
+uniform sampler2DArray deinterleavedOcclusion;
+
+// puts every pixel's occlusion back from the layer it was computed in, see ssao_deinterleave.frag
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	FragColor = texelFetch(deinterleavedOcclusion, ivec3(pixel / 4, (pixel.y % 4) * 4 + pixel.x % 4), 0).r;
+}
@@ -0,0 +1,48 @@
+#version 330 core
+
+layout (location = 0) out vec2 History;		// x: accumulated occlusion, y: number of frames averaged into it
+layout (location = 1) out float HistoryDepth;	// linear view depth the next frame checks its reprojection against
+
+in vec2 TexCoords;
+
+#include "gbuffer.glsl"
+
+// permutation: COMPACT_GBUFFER
+
+uniform sampler2D currentOcclusion;
+uniform sampler2D historyOcclusion;
+uniform sampler2D historyDepth;
+uniform mat4 reprojection;	// this frame's view space to last frame's clip space
+
+// the history is a plain average of up to this many frames, after that an exponential moving average
+const float MAX_HISTORY_FRAMES = 16.0;
+
+// relative depth difference beyond which the reprojected history belongs to a different surface
+const float DISOCCLUSION_THRESHOLD = 0.02;
+
+void main()
+{
+	vec3 position = GetViewPosition(TexCoords);
+	float occlusion = texture(currentOcclusion, TexCoords).r;
+
+	// where this surface was on screen last frame. With a perspective projection w is its view depth back then.
+	vec4 previous = reprojection * vec4(position, 1.0);
+	vec2 previousUV = previous.xy / previous.w * 0.5 + 0.5;
+
+	// drop the history when the pixel was off screen or covered by something else last frame
+	float frames = 0.0;
+	vec2 history = vec2(occlusion, 0.0);
+	if (all(greaterThanEqual(previousUV, vec2(0.0))) && all(lessThanEqual(previousUV, vec2(1.0))))
+	{
+		float previousDepth = texture(historyDepth, previousUV).r;
+		if (abs(previousDepth - previous.w) < DISOCCLUSION_THRESHOLD * previous.w)
+		{
+			history = texture(historyOcclusion, previousUV).rg;
+			frames = history.y;
+		}
+	}
+
+	frames = min(frames + 1.0, MAX_HISTORY_FRAMES);
+	History = vec2(mix(history.x, occlusion, 1.0 / frames), frames);
+	HistoryDepth = -position.z;
+}
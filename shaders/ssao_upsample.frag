@@ -0,0 +1,18 @@
+#version 330 core
+
+layout (location = 0) out float FragColor;
+
+in vec2 TexCoords;
+
+#include "gbuffer.glsl"
+#include "bilateral_upsample.glsl"
+
+// permutation: COMPACT_GBUFFER
+
+uniform sampler2D lowResDepth;		// linear view depth the reduced resolution SSAO ran on
+uniform sampler2D lowResOcclusion;
+
+void main()
+{
+	FragColor = BilateralUpsample(lowResDepth, lowResOcclusion, TexCoords, GetViewDepth(TexCoords));
+}
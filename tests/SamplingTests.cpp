@@ -0,0 +1,119 @@
+// Checks of the CPU side sampling library in Sampling.h. Needs no GL context: build it on its own against cyCodeBase,
+// e.g. g++ -std=c++17 -I<cyCodeBase> -I.. SamplingTests.cpp, and run it. Returns the number of failed checks.
+
+#include "../Sampling.h"
+#include <cstdio>
+
+// kernel size and subsets the renderer uses (NUM_SAMPLES, NUM_SAMPLES / ADAPTIVE_BATCH)
+const unsigned int KERNEL_SIZE = 64;
+const unsigned int KERNEL_SUBSETS = 8;
+const unsigned int NOISE_SIZE = 64;
+
+unsigned int failures = 0;
+
+void Check(bool passed, const char* what, const char* pattern)
+{
+	if (passed) return;
+	printf("FAILED: %s (%s)\n", what, pattern);
+	failures++;
+}
+
+// GenerateSampleKernel as it was before the sampling library, which KERNEL_RANDOM has to keep reproducing
+vector<cyVec3f> GenerateOriginalKernel(unsigned int count)
+{
+	uniform_real_distribution<float> randomFloats(0.0, 1.0);
+	default_random_engine generator;
+
+	vector<cyVec3f> kernel;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		cyVec3f sample(randomFloats(generator) * 2.0 - 1.0, randomFloats(generator) * 2.0 - 1.0, randomFloats(generator));
+		sample.Normalize();
+		sample *= randomFloats(generator);
+
+		float scale = float(i) / count;
+		float a = 0.1f, b = 1.0f;
+		scale = a + scale * scale * (b - a);
+		sample *= scale;
+		kernel.push_back(sample);
+	}
+	return kernel;
+}
+
+void CheckHemisphere(const vector<cyVec3f>& kernel, const char* pattern)
+{
+	bool inside = kernel.size() == KERNEL_SIZE;
+	for (const cyVec3f& sample : kernel)
+		inside = inside && sample.z >= 0.0f && sample.Length() <= 1.0f + 1e-5f;
+	Check(inside, "every sample lies in the unit hemisphere", pattern);
+}
+
+// every subset on its own has to reach around the normal and from the tangent plane up towards the pole: a sample in
+// each quarter of the circle around the normal, one below and one above 45 degrees, and no strong lean to one side
+void CheckSubsetSpread(const vector<cyVec3f>& kernel, const char* pattern)
+{
+	bool spread = true;
+	for (unsigned int subset = 0; subset < KERNEL_SUBSETS; subset++)
+	{
+		bool quadrant[4] = { false, false, false, false };
+		bool low = false, high = false;
+		float meanX = 0.0f, meanY = 0.0f;
+		unsigned int size = 0;
+		for (unsigned int i = subset; i < kernel.size(); i += KERNEL_SUBSETS)
+		{
+			cyVec3f direction = kernel[i].GetNormalized();
+			quadrant[(direction.x < 0.0f ? 1 : 0) + (direction.y < 0.0f ? 2 : 0)] = true;
+			low = low || direction.z < 0.7071f;
+			high = high || direction.z >= 0.7071f;
+			meanX += direction.x;
+			meanY += direction.y;
+			size++;
+		}
+		meanX /= size;
+		meanY /= size;
+		spread = spread && quadrant[0] && quadrant[1] && quadrant[2] && quadrant[3] && low && high &&
+			sqrt(meanX * meanX + meanY * meanY) < 0.35f;
+	}
+	Check(spread, "every subset spreads over the hemisphere", pattern);
+}
+
+void CheckOriginalKernel()
+{
+	vector<cyVec3f> kernel = GenerateKernel(KERNEL_SIZE, KERNEL_RANDOM, KERNEL_SUBSETS);
+	vector<cyVec3f> original = GenerateOriginalKernel(KERNEL_SIZE);
+	bool same = kernel.size() == original.size();
+	for (size_t i = 0; same && i < kernel.size(); i++)
+		same = kernel[i].x == original[i].x && kernel[i].y == original[i].y && kernel[i].z == original[i].z;
+	Check(same, "reproduces the original kernel", GetKernelPatternName(KERNEL_RANDOM));
+}
+
+void CheckBlueNoise()
+{
+	vector<float> noise = GenerateBlueNoise(NOISE_SIZE);
+	unsigned int count = NOISE_SIZE * NOISE_SIZE;
+	vector<bool> seen(count, false);
+	bool permutation = noise.size() == count;
+	for (float value : noise)
+	{
+		int rank = (int)floor(value * count);
+		permutation = permutation && rank >= 0 && rank < (int)count && !seen[rank];
+		if (permutation) seen[rank] = true;
+	}
+	Check(permutation, "ranks are a permutation of 0..n-1", "blue noise");
+}
+
+int main()
+{
+	for (unsigned int pattern = 0; pattern < KERNEL_PATTERN_COUNT; pattern++)
+	{
+		vector<cyVec3f> kernel = GenerateKernel(KERNEL_SIZE, (KernelPattern)pattern, KERNEL_SUBSETS);
+		CheckHemisphere(kernel, GetKernelPatternName((KernelPattern)pattern));
+		// the random kernel makes no promise about its subsets
+		if (pattern != KERNEL_RANDOM) CheckSubsetSpread(kernel, GetKernelPatternName((KernelPattern)pattern));
+	}
+	CheckOriginalKernel();
+	CheckBlueNoise();
+
+	printf(failures == 0 ? "All sampling checks passed\n" : "%u sampling checks failed\n", failures);
+	return (int)failures;
+}